@@ -0,0 +1,278 @@
+// Macro benchmark for the tick loop on generated galaxies.
+//
+// Prints one JSON object per run on stdout so results can be appended to
+// a file and compared across versions, e.g.
+//
+//   ./27kelvin-bench -s 100000 -f 10000 -o 16 -r 5 -n 2000 -l $(git rev-parse --short HEAD) >> bench.jsonl
+
+#include "./sim.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <chrono>
+#include <random>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Timings {
+  std::vector<double> samples; // microseconds
+
+  void add(Clock::time_point start, Clock::time_point end) {
+    samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+  }
+
+  double total() const {
+    double sum = 0;
+    for(auto&& s : samples) { sum += s; }
+    return sum;
+  }
+
+  double percentile(double p) {
+    if(samples.empty()) {
+      return 0;
+    }
+    size_t n = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+    return samples[n];
+  }
+};
+
+// Peak resident set size since the last reset_peak_rss() in kB. Linux lets
+// us reset the high water mark through clear_refs, elsewhere this is the
+// peak for the whole process.
+static void reset_peak_rss() {
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if(f) {
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+static long peak_rss_kb() {
+  FILE *f = fopen("/proc/self/status", "r");
+  if(f) {
+    char line[256];
+    long kb = -1;
+    while(fgets(line, sizeof(line), f)) {
+      if(sscanf(line, "VmHWM: %ld kB", &kb) == 1) {
+	break;
+      }
+    }
+    fclose(f);
+    if(kb >= 0) {
+      return kb;
+    }
+  }
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+static void print_timings(const char *name, Timings& t, bool last = false) {
+  printf("\"%s\":{\"total_ms\":%.3f,\"p50_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f}%s",
+	 name, t.total() / 1000.0, t.percentile(0.5), t.percentile(0.99), t.percentile(1.0),
+	 last ? "" : ",");
+}
+
+// issue orders like players would: random docked fleets to random stars
+static void random_orders(Simulation& sim, std::mt19937& rng, double rate, double& carry) {
+  carry += rate;
+  auto& fleets = sim.fleets.fleets;
+  auto& stars = sim.stars.stars;
+
+  while(carry >= 1 and not fleets.empty()) {
+    carry -= 1;
+    // a few tries to find a docked fleet, don't scan everything
+    for(int tries = 0; tries < 8; tries++) {
+      std::shared_ptr<Fleet> f = fleets[rng() % fleets.size()];
+      if(f->moving == true or not f->path.empty()) {
+	continue;
+      }
+      std::shared_ptr<Star> s = stars[rng() % stars.size()];
+      if(s != f->source) {
+	sim.order(f, f->source, s, sim.obs.human_controller);
+      }
+      break;
+    }
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+	  "usage: %s [-s stars] [-f fleets] [-o observers] [-r orders_per_tick]\n"
+	  "          [-n ticks] [-w warmup_ticks] [-p path_queries] [-j threads] [-S seed] [-l label]\n"
+	  "          [-L save] [-W save]\n"
+	  "  -s stars          stars in the generated galaxy (default 1000)\n"
+	  "  -f fleets         fleets (default 100)\n"
+	  "  -o observers      observers/factions (default 2)\n"
+	  "  -r orders         fleet orders issued per tick, may be fractional (default 1)\n"
+	  "  -n ticks          measured ticks (default 1000)\n"
+	  "  -w warmup_ticks   unmeasured ticks before measuring (default 100)\n"
+	  "  -p path_queries   random StarGraph::pathfind and ::plan queries (default 1000)\n"
+	  "  -j threads        workers for Observations::update, -1 for one per extra core (default -1)\n"
+	  "  -S seed           seed for the galaxy and the orders (default 1)\n"
+	  "  -l label          free text copied to the output, e.g. a commit hash\n"
+	  "  -L save           load the galaxy from a save instead of generating it, setup_ms is the load\n"
+	  "  -W save           save the galaxy once it's set up\n",
+	  argv0);
+}
+
+int main(int argc, char **argv)
+{
+  Scenario sc;
+  double order_rate = 1;
+  long ticks = 1000;
+  long warmup = 100;
+  long path_queries = 1000;
+  const char *label = "";
+  const char *load = NULL;
+  const char *save = NULL;
+  g_sim_log = false;
+
+  int opt;
+  while((opt = getopt(argc, argv, "s:f:o:r:n:w:p:j:S:l:L:W:h")) != -1) {
+    switch(opt)
+      {
+      case 's': { sc.stars = atoi(optarg); }; break;
+      case 'f': { sc.fleets = atoi(optarg); }; break;
+      case 'o': { sc.observers = atoi(optarg); }; break;
+      case 'r': { order_rate = atof(optarg); }; break;
+      case 'n': { ticks = atol(optarg); }; break;
+      case 'w': { warmup = atol(optarg); }; break;
+      case 'p': { path_queries = atol(optarg); }; break;
+      case 'j': { g_sim_threads = atoi(optarg); }; break;
+      case 'S': { sc.seed = atoi(optarg); }; break;
+      case 'l': { label = optarg; }; break;
+      case 'L': { load = optarg; }; break;
+      case 'W': { save = optarg; }; break;
+      default: { usage(argv[0]); return 1; }; break;
+      }
+  }
+
+  if(sc.stars < 2 or sc.fleets < 1 or sc.observers < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // setup
+  reset_peak_rss();
+  auto setup_start = Clock::now();
+  Simulation sim;
+  if(load) {
+    if(not sim.load(load)) {
+      fprintf(stderr, "%s: can't load save\n", load);
+      return 1;
+    }
+    sc = sim.scenario;
+  }
+  else {
+    sim.generate(sc);
+  }
+  auto setup_end = Clock::now();
+  long setup_rss = peak_rss_kb();
+  if(save and not sim.save(save)) {
+    perror(save);
+    return 1;
+  }
+
+  std::mt19937 rng(sc.seed + 1);
+  double carry = 0;
+
+  for(long i = 0; i < warmup; i++) {
+    random_orders(sim, rng, order_rate, carry);
+    sim.tick();
+  }
+
+  // tick loop. this is Simulation::tick with a clock around each phase,
+  // keep the two in sync
+  Timings tick_t, fleets_t, obs_t;
+  long events_created = 0;
+  long max_events = 0;
+
+  reset_peak_rss();
+  for(long i = 0; i < ticks; i++) {
+    // the orders' events are made before the tick resets the count
+    sim.obs.tick_events_created = 0;
+    random_orders(sim, rng, order_rate, carry);
+    events_created += sim.obs.tick_events_created;
+
+    auto t0 = Clock::now();
+    sim.t++;
+    sim.log.year = sim.t;
+    sim.obs.tick_events_created = 0;
+    sim.fleets.update(sim.obs, sim);
+    auto t1 = Clock::now();
+    sim.obs.update(sim.stars.graph, sim.fleets, sim.log);
+    auto t2 = Clock::now();
+    sim.stars.update();
+    auto t3 = Clock::now();
+
+    fleets_t.add(t0, t1);
+    obs_t.add(t1, t2);
+    tick_t.add(t0, t3);
+    events_created += sim.obs.tick_events_created;
+    max_events = std::max(max_events, (long)sim.obs.events.size());
+  }
+  long tick_rss = peak_rss_kb();
+
+  // pathfinding between random pairs of stars
+  Timings path_t;
+  long path_hops = 0;
+  long path_failed = 0;
+
+  reset_peak_rss();
+  for(long i = 0; i < path_queries; i++) {
+    auto& stars = sim.stars.stars;
+    std::shared_ptr<Star> from = stars[rng() % stars.size()];
+    std::shared_ptr<Star> to = stars[rng() % stars.size()];
+
+    auto t0 = Clock::now();
+    auto path = sim.stars.graph.pathfind(from, to);
+    auto t1 = Clock::now();
+
+    path_t.add(t0, t1);
+    if(path.empty()) { path_failed++; }
+    path_hops += path.size();
+  }
+  long path_rss = peak_rss_kb();
+
+  // the same for the routes fleets are given, hierarchical on big maps
+  Timings plan_t;
+  for(long i = 0; i < path_queries; i++) {
+    auto& stars = sim.stars.stars;
+    std::shared_ptr<Star> from = stars[rng() % stars.size()];
+    std::shared_ptr<Star> to = stars[rng() % stars.size()];
+    std::vector<std::weak_ptr<Star>> waypoints;
+
+    auto t0 = Clock::now();
+    sim.stars.graph.plan(from, to, waypoints);
+    auto t1 = Clock::now();
+
+    plan_t.add(t0, t1);
+  }
+
+  double tick_secs = tick_t.total() / 1e6;
+  double path_secs = path_t.total() / 1e6;
+
+  printf("{\"label\":\"%s\",", label);
+  printf("\"stars\":%d,\"fleets\":%d,\"observers\":%d,\"orders_per_tick\":%g,\"seed\":%u,",
+	 sc.stars, sc.fleets, sc.observers, order_rate, sc.seed);
+  printf("\"ticks\":%ld,\"warmup_ticks\":%ld,\"threads\":%ld,", ticks, warmup, sim.obs.workers.size());
+  printf("\"setup_ms\":%.3f,\"setup_peak_rss_kb\":%ld,",
+	 std::chrono::duration<double, std::milli>(setup_end - setup_start).count(), setup_rss);
+  printf("\"ticks_per_sec\":%.1f,\"tick_peak_rss_kb\":%ld,", tick_secs > 0 ? ticks / tick_secs : 0, tick_rss);
+  printf("\"events_created\":%ld,\"max_events_in_flight\":%ld,", events_created, max_events);
+  print_timings("tick", tick_t);
+  print_timings("fleets_update", fleets_t);
+  print_timings("observations_update", obs_t);
+  printf("\"route_cache_hits\":%ld,\"route_cache_misses\":%ld,",
+	 sim.stars.graph.route_cache_hits, sim.stars.graph.route_cache_misses);
+  printf("\"path_queries\":%ld,\"path_queries_per_sec\":%.1f,\"path_mean_hops\":%.2f,\"path_failed\":%ld,\"path_peak_rss_kb\":%ld,",
+	 path_queries, path_secs > 0 ? path_queries / path_secs : 0,
+	 path_queries > 0 ? (double)path_hops / path_queries : 0, path_failed, path_rss);
+  print_timings("pathfind", path_t);
+  print_timings("plan", plan_t, true);
+  printf("}\n");
+}
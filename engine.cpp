@@ -4,11 +4,16 @@
 
 ImFont *bigger;
 
+// dragging a window edge sends a stream of resize events, ImGui's device
+// objects are made again once there hasn't been one for this long
+static const double RESIZE_SETTLE = 0.25;
+
 Engine::Engine(const char *win_title, float win_sx, float win_sy) {
   title = win_title;
   sx = win_sx;
   sy = win_sy;
   draw_background = true;
+  device_reset_at = 0;
 }
 
 void Engine::init() {
@@ -66,9 +71,8 @@ void Engine::begin_frame() {
     }
     else if (ev.type == ALLEGRO_EVENT_DISPLAY_RESIZE) {
       resize_window();
-      ImGui_ImplA5_InvalidateDeviceObjects();
       al_acknowledge_resize(display);
-      Imgui_ImplA5_CreateDeviceObjects();
+      device_reset_at = al_get_time() + RESIZE_SETTLE;
     }
     else if(ev.type == ALLEGRO_EVENT_KEY_DOWN) {
       key = ev.keyboard.keycode;
@@ -93,6 +97,12 @@ void Engine::begin_frame() {
       mouse_btn_down = false;
     }
   }
+
+  if(device_reset_at > 0 and al_get_time() >= device_reset_at) {
+    device_reset_at = 0;
+    ImGui_ImplA5_InvalidateDeviceObjects();
+    Imgui_ImplA5_CreateDeviceObjects();
+  }
   ImGui_ImplA5_NewFrame();
 }
 
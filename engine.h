@@ -28,6 +28,7 @@ struct Engine {
   bool running;
   bool debug_win;
   bool draw_background;
+  double device_reset_at; // al_get_time() to remake ImGui's device objects after a resize, 0 if not
 
   Engine(const char *win_title, float win_sx, float win_sy);
   void init();
@@ -13,6 +13,9 @@
 #include "imgui_impl_a5.h"
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_primitives.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef _WIN32
 #include <allegro5/allegro_windows.h>
@@ -25,6 +28,15 @@ static double                   g_Time = 0.0;
 static ALLEGRO_MOUSE_CURSOR*    g_MouseCursorInvisible = NULL;
 static ALLEGRO_VERTEX_DECL*     g_VertexDecl = NULL;
 
+// Each draw list is uploaded into these once and its commands drawn from
+// them. They're kept between frames and grown as needed. If the driver
+// can't make them we draw from client memory instead.
+static ALLEGRO_VERTEX_BUFFER*   g_VertexBuffer = NULL;
+static ALLEGRO_INDEX_BUFFER*    g_IndexBuffer = NULL;
+static int                      g_VertexBufferSize = 0;
+static int                      g_IndexBufferSize = 0;
+static bool                     g_BuffersUnsupported = false;
+
 #define OFFSETOF(TYPE, ELEMENT) ((size_t)&(((TYPE *)0)->ELEMENT))
 
 struct ImDrawVertAllegro
@@ -34,6 +46,94 @@ struct ImDrawVertAllegro
     ALLEGRO_COLOR col;
 };
 
+// Allegro doesn't support 32-bits packed colors so we have to convert them to 4 floats
+static void ImGui_ImplA5_ConvertVertices(const ImDrawVert* src, ImDrawVertAllegro* dst, int count)
+{
+#ifdef __SSE2__
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    const __m128i zero = _mm_setzero_si128();
+    for (int i = 0; i < count; i++)
+    {
+        dst[i].pos = src[i].pos;
+        dst[i].uv = src[i].uv;
+        // r, g, b, a bytes widened to 4 ints, then to floats
+        __m128i c = _mm_cvtsi32_si128((int)src[i].col);
+        c = _mm_unpacklo_epi16(_mm_unpacklo_epi8(c, zero), zero);
+        _mm_storeu_ps(&dst[i].col.r, _mm_mul_ps(_mm_cvtepi32_ps(c), scale));
+    }
+#else
+    static float to_float[256];
+    if (to_float[255] == 0.0f)
+        for (int i = 0; i < 256; i++)
+            to_float[i] = i / 255.0f;
+    for (int i = 0; i < count; i++)
+    {
+        dst[i].pos = src[i].pos;
+        dst[i].uv = src[i].uv;
+        const unsigned char *c = (const unsigned char*)&src[i].col;
+        dst[i].col.r = to_float[c[0]];
+        dst[i].col.g = to_float[c[1]];
+        dst[i].col.b = to_float[c[2]];
+        dst[i].col.a = to_float[c[3]];
+    }
+#endif
+}
+
+// Grows one of the persistent buffers to hold at least count elements
+static int ImGui_ImplA5_BufferSize(int size, int count)
+{
+    int new_size = size > 0 ? size : 4096;
+    while (new_size < count)
+        new_size *= 2;
+    return new_size;
+}
+
+// Copies a draw list into the persistent buffers, false if they can't be used
+static bool ImGui_ImplA5_UploadDrawList(const ImDrawList* cmd_list)
+{
+    if (g_BuffersUnsupported)
+        return false;
+
+    const int vtx_count = cmd_list->VtxBuffer.size();
+    const int idx_count = cmd_list->IdxBuffer.size();
+    if (vtx_count == 0 || idx_count == 0)
+        return true;
+
+    if (vtx_count > g_VertexBufferSize)
+    {
+        if (g_VertexBuffer)
+            al_destroy_vertex_buffer(g_VertexBuffer);
+        g_VertexBufferSize = ImGui_ImplA5_BufferSize(g_VertexBufferSize, vtx_count);
+        g_VertexBuffer = al_create_vertex_buffer(g_VertexDecl, NULL, g_VertexBufferSize, ALLEGRO_PRIM_BUFFER_STREAM);
+    }
+    if (idx_count > g_IndexBufferSize)
+    {
+        if (g_IndexBuffer)
+            al_destroy_index_buffer(g_IndexBuffer);
+        g_IndexBufferSize = ImGui_ImplA5_BufferSize(g_IndexBufferSize, idx_count);
+        // ImDrawIdx is 16-bit unless imconfig.h says otherwise, Allegro takes either
+        g_IndexBuffer = al_create_index_buffer(sizeof(ImDrawIdx), NULL, g_IndexBufferSize, ALLEGRO_PRIM_BUFFER_STREAM);
+    }
+    if (!g_VertexBuffer || !g_IndexBuffer)
+    {
+        g_BuffersUnsupported = true;
+        return false;
+    }
+
+    ImDrawVertAllegro* vertices = (ImDrawVertAllegro*)al_lock_vertex_buffer(g_VertexBuffer, 0, vtx_count, ALLEGRO_LOCK_WRITEONLY);
+    if (!vertices)
+        return false;
+    ImGui_ImplA5_ConvertVertices(cmd_list->VtxBuffer.Data, vertices, vtx_count);
+    al_unlock_vertex_buffer(g_VertexBuffer);
+
+    void* indices = al_lock_index_buffer(g_IndexBuffer, 0, idx_count, ALLEGRO_LOCK_WRITEONLY);
+    if (!indices)
+        return false;
+    memcpy(indices, cmd_list->IdxBuffer.Data, idx_count * sizeof(ImDrawIdx));
+    al_unlock_index_buffer(g_IndexBuffer);
+    return true;
+}
+
 void ImGui_ImplA5_RenderDrawLists(ImDrawData* draw_data)
 {
     int op, src, dst;
@@ -43,27 +143,20 @@ void ImGui_ImplA5_RenderDrawLists(ImDrawData* draw_data)
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        const bool uploaded = ImGui_ImplA5_UploadDrawList(cmd_list);
 
-        // FIXME-OPT: Unfortunately Allegro doesn't support 32-bits packed colors so we have to convert them to 4 floats
         static ImVector<ImDrawVertAllegro> vertices;
-        vertices.resize(cmd_list->VtxBuffer.size());
-        for (int i = 0; i < cmd_list->VtxBuffer.size(); ++i)
+        static ImVector<int> indices;
+        if (!uploaded)
         {
-            const ImDrawVert &dv = cmd_list->VtxBuffer[i];
-            ImDrawVertAllegro v;
-            v.pos = dv.pos;
-            v.uv = dv.uv;
-            unsigned char *c = (unsigned char*)&dv.col;
-            v.col = al_map_rgba(c[0], c[1], c[2], c[3]);
-            vertices[i] = v;
-        }
+            vertices.resize(cmd_list->VtxBuffer.size());
+            ImGui_ImplA5_ConvertVertices(cmd_list->VtxBuffer.Data, vertices.Data, cmd_list->VtxBuffer.size());
 
-        // FIXME-OPT: Unfortunately Allegro doesn't support 16-bit indices
-        // You can also use '#define ImDrawIdx unsigned int' in imconfig.h and request ImGui to output 32-bit indices
-        static ImVector<int> indices;
-        indices.resize(cmd_list->IdxBuffer.size());
-        for (int i = 0; i < cmd_list->IdxBuffer.size(); ++i)
-            indices[i] = (int)cmd_list->IdxBuffer.Data[i];
+            // al_draw_indexed_prim only takes int indices
+            indices.resize(cmd_list->IdxBuffer.size());
+            for (int i = 0; i < cmd_list->IdxBuffer.size(); ++i)
+                indices[i] = (int)cmd_list->IdxBuffer.Data[i];
+        }
 
         int idx_offset = 0;
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.size(); cmd_i++)
@@ -73,11 +166,14 @@ void ImGui_ImplA5_RenderDrawLists(ImDrawData* draw_data)
             {
                 pcmd->UserCallback(cmd_list, pcmd);
             }
-            else
+            else if (pcmd->ElemCount > 0)
             {
                 ALLEGRO_BITMAP* texture = (ALLEGRO_BITMAP*)pcmd->TextureId;
                 al_set_clipping_rectangle(pcmd->ClipRect.x, pcmd->ClipRect.y, pcmd->ClipRect.z-pcmd->ClipRect.x, pcmd->ClipRect.w-pcmd->ClipRect.y);
-                al_draw_indexed_prim(&vertices[0], g_VertexDecl, texture, &indices[idx_offset], pcmd->ElemCount, ALLEGRO_PRIM_TRIANGLE_LIST);
+                if (uploaded)
+                    al_draw_indexed_buffer(g_VertexBuffer, texture, g_IndexBuffer, idx_offset, idx_offset + pcmd->ElemCount, ALLEGRO_PRIM_TRIANGLE_LIST);
+                else
+                    al_draw_indexed_prim(&vertices[0], g_VertexDecl, texture, &indices[idx_offset], pcmd->ElemCount, ALLEGRO_PRIM_TRIANGLE_LIST);
             }
             idx_offset += pcmd->ElemCount;
         }
@@ -148,6 +244,19 @@ void ImGui_ImplA5_InvalidateDeviceObjects()
         al_destroy_mouse_cursor(g_MouseCursorInvisible);
         g_MouseCursorInvisible = NULL;
     }
+    if (g_VertexBuffer)
+    {
+        al_destroy_vertex_buffer(g_VertexBuffer);
+        g_VertexBuffer = NULL;
+    }
+    if (g_IndexBuffer)
+    {
+        al_destroy_index_buffer(g_IndexBuffer);
+        g_IndexBuffer = NULL;
+    }
+    g_VertexBufferSize = 0;
+    g_IndexBufferSize = 0;
+    g_BuffersUnsupported = false;
 }
 
 bool ImGui_ImplA5_Init(ALLEGRO_DISPLAY* display)
@@ -155,7 +264,7 @@ bool ImGui_ImplA5_Init(ALLEGRO_DISPLAY* display)
     g_Display = display;
 
     // Create custom vertex declaration.
-    // Unfortunately Allegro doesn't support 32-bits packed colors so we have to convert them to 4 floats.
+    // Unfortunately Allegro doesn't support 32-bits packed colors so we have to convert them to 4 floats, see ImGui_ImplA5_ConvertVertices().
     // We still use a custom declaration to use 'ALLEGRO_PRIM_TEX_COORD' instead of 'ALLEGRO_PRIM_TEX_COORD_PIXEL' else we can't do a reliable conversion.
     ALLEGRO_VERTEX_ELEMENT elems[] =
     {
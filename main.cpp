@@ -1,957 +1,877 @@
 #include "./engine.h"
+#include "./sim.h"
 
 #include <stdio.h>
+#include <unistd.h>
 #include <vector>
-#include <deque>
-#include <algorithm>
 #include <memory>
-#include <mutex>
-#include <sstream>
 
-const float PX_PER_LIGHTYEAR = 50;
 const int TICKS_PER_SECOND = 2;
-
-struct Observer;
-struct Fleet;
-struct Star;
+const char *SAVE_FILE = "27kelvin.save";
+const char *AUTOSAVE_FILE = "27kelvin.autosave";
 
 bool g_draw_influence_circles = true;
-bool g_draw_fleet_traces = true;
 bool g_star_moving = true;
 bool g_star_connecting = false;
 
 std::weak_ptr<Star> g_selected_star1;
 std::weak_ptr<Star> g_selected_star2;
-std::weak_ptr<Fleet> g_selected_fleet;
+std::weak_ptr<const FleetState> g_selected_fleet;
 
-static inline const char *get_fleet_name(const Fleet& f);
 void add_fleet_buttons_for_obs(const Star& s, const Observer& o);
-float distance_to_star(const Observer& o, const Star& s);
 std::shared_ptr<Star> star_from_name(const char *name);
-const char *get_observer_name(const Observer& o);
+void star_moved(Star& star, float x, float y);
 
 ALLEGRO_COLOR c_steelblue;
 ALLEGRO_COLOR c_stars_bg;
 
-static inline float lerp(float v0, float v1, float t) {
-  return (1 - t) * v0 + t * v1;
+static inline ALLEGRO_COLOR al_color(const Color& c) {
+  return al_map_rgb(c.r, c.g, c.b);
 }
 
-struct Star {
-  int id;
-  int index; // index into the stars vector
-  char *name; // freed by struct Stars
-  // star position
-  float x, y;
-  // imgui window offset for centering
-  float wx = 0;
-  float wy = 0;
-  int focus = 0;
-  std::weak_ptr<Observer> owner;
-  std::vector<std::weak_ptr<Star>> neighbors;
-  bool moving = false;
+// Triangles for the map, collected and then drawn with one al_draw_prim
+struct PrimBatch {
+  std::vector<ALLEGRO_VERTEX> v;
 
-  // only used by struct Stars
-  Star(const char *_name, float _x, float _y, int _id) {
-    name = strdup(_name); x = _x; y = _y; id = _id;
+  void vertex(float x, float y, ALLEGRO_COLOR c) {
+    v.push_back(ALLEGRO_VERTEX { x, y, 0, 0, 0, c });
   }
 
-  void update() {
+  void quad(float x0, float y0, float x1, float y1, float x2, float y2, float x3, float y3, ALLEGRO_COLOR c) {
+    vertex(x0, y0, c); vertex(x1, y1, c); vertex(x2, y2, c);
+    vertex(x0, y0, c); vertex(x2, y2, c); vertex(x3, y3, c);
   }
 
-  void set_full_owner(std::shared_ptr<Observer>& o) {
-    owner = o;
+  // segments for span radians of a circle of radius r, so that none
+  // is more than half a pixel off the circle
+  static int segments(float r, float span = 2 * M_PI) {
+    return std::max(span > 6 ? 8 : 1, (int)ceilf(span * sqrtf(std::max(r, 1.0f)) / 2));
   }
 
-  void draw(float offx, float offy, const Observer& viewer) {
-    ImGuiWindowFlags flags = ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize;
-    if(moving == false) {
-      flags = flags | ImGuiWindowFlags_NoMove;
-      ImGui::SetNextWindowPos(ImVec2(x - offx - wx/2, y - offy - wy/2));
+  void disc(float x, float y, float r, ALLEGRO_COLOR c) {
+    int n = segments(r);
+    float px = x + r, py = y;
+    for(int i = 1; i <= n; i++) {
+      float a = 2 * M_PI * i / n;
+      float qx = x + r * cosf(a), qy = y + r * sinf(a);
+      vertex(x, y, c); vertex(px, py, c); vertex(qx, qy, c);
+      px = qx;
+      py = qy;
     }
+  }
 
-    ImGui::Begin(name, NULL, flags);
-    bool pressed = ImGui::Button(name);
-    if(pressed == true) {
-      if(not g_selected_fleet.lock()) {
-	ImGui::OpenPopup("star menu");
-      }
-      else {
-	g_selected_star1 = star_from_name(this->name);
-      }
+  // the part of a ring from angle a0 to a0 + span
+  void arc(float x, float y, float r, float thickness, float a0, float span, ALLEGRO_COLOR c) {
+    int n = segments(r, span);
+    float r0 = r - thickness / 2, r1 = r + thickness / 2;
+    float pc = cosf(a0), ps = sinf(a0);
+    for(int i = 1; i <= n; i++) {
+      float a = a0 + span * i / n;
+      float qc = cosf(a), qs = sinf(a);
+      quad(x + r0 * pc, y + r0 * ps, x + r1 * pc, y + r1 * ps,
+	   x + r1 * qc, y + r1 * qs, x + r0 * qc, y + r0 * qs, c);
+      pc = qc;
+      ps = qs;
     }
+  }
 
-    if(ImGui::BeginPopup("star menu")) {
-      if(g_star_moving == true) {
-
-	if(ImGui::Button("Connect")) {
-	  if(g_selected_star1.lock()) {
-	    g_selected_star2 = star_from_name(this->name);
-	  }
-	  else {
-	    g_selected_star1 = star_from_name(this->name);
-	  }
-	}
-
-	if(ImGui::Button("moving")) {
-	  moving = true;
-	}
-
-	if(moving == true) {
-	  ImGui::SameLine();
-	  if(ImGui::Button("Commit")) {
-	    moving = false;
-	    ImVec2 pos = ImGui::GetWindowPos();
-	    x = pos.x + offx;
-	    y = pos.y + offy;
-	    printf("%s moved to %f, %f\n", name, x, y);
-	  }
-	}
-      }
-
-      ImGui::PushItemWidth(300);
-      ImGui::Columns(2);
-      ImGui::Text("%s             ", name);
-      ImGui::Button("System Info");
-      ImGui::NextColumn();
-      ImGui::Text("Fleets:        ");
-      add_fleet_buttons_for_obs(*this, viewer);
-      ImGui::PopItemWidth();
-      ImGui::EndPopup();
-    }
-
-    if(ImGui::IsItemHovered()) {
-      ImGui::BeginTooltip();
-      ImGui::Text("%s", name);
-      float distance = distance_to_star(viewer, *this);
-      if(distance > 0.1) {
-	ImGui::Separator();
-	ImGui::Text("Distance: %.1fly", distance);
-      }
-      if(auto o = owner.lock()) {
-	if(distance < 0.1) {
-	  ImGui::Separator();
-	}
-	ImGui::Text("Owner: %s", get_observer_name(*o));
-      }
-      ImGui::EndTooltip();
+  void line(float x1, float y1, float x2, float y2, float thickness, ALLEGRO_COLOR c) {
+    float dx = x2 - x1, dy = y2 - y1;
+    float len = sqrtf(dx * dx + dy * dy);
+    if(len == 0) {
+      return;
     }
-
-    // Is there a way to do this without the first frame being borked?
-    wy = ImGui::GetWindowHeight();
-    wx = ImGui::GetWindowWidth();
-    ImGui::End();
+    float nx = -dy / len * thickness / 2, ny = dx / len * thickness / 2;
+    quad(x1 + nx, y1 + ny, x2 + nx, y2 + ny, x2 - nx, y2 - ny, x1 - nx, y1 - ny, c);
   }
-};
 
-struct Stars;
-
-struct StarGraph {
-  Stars* s;
-
-  StarGraph() = default;
-  StarGraph(Stars* _s) {
-    s = _s;
+  void draw() {
+    if(not v.empty()) {
+      al_draw_prim(v.data(), NULL, NULL, 0, v.size(), ALLEGRO_PRIM_TRIANGLE_LIST);
+    }
+    v.clear();
   }
-
-  std::vector<std::weak_ptr<Star>> shown_path;
-
-  void add(const std::shared_ptr<Star>& s1, const std::shared_ptr<Star>& s2);
-  void draw(float offx, float offy);
-  std::vector<std::weak_ptr<Star>> pathfind(const std::shared_ptr<Star>& from, const std::shared_ptr<Star>& to) const;
 };
 
-/*
- * Other events?
- *
- *   observer requests general status report?
- *
- */
-
-enum class ObservableEventType { FleetDeparture, FleetArrival, FleetIdle, OrderFleetMove, CombatReport };
-
-struct Fleet;
-
-struct ObservableEvent {
-  ObservableEvent(ObservableEventType _type, float _x, float _y, int _id) {
-    id = _id;
-    type = _type;
-    x = _x;
-    y = _y;
-    t = 0;
-  }
+// What's on the map this frame by its box on screen, bucketed into a grid
+// of cell by cell squares, for finding what's under the mouse
+struct HitGrid {
+  static const int cell = 64;
 
-  int id;
-  ObservableEventType type;
-  float x, y;
-  float t;
+  enum class Kind { Star, Fleet };
 
-  // TODO should be weak_ptrs?
-  std::shared_ptr<Observer> orderSender;
-  std::shared_ptr<Star> orderTarget;
-  std::shared_ptr<Star> orderMoveTo;
-  std::shared_ptr<Fleet> fleet1;
-};
+  struct Item {
+    Kind kind;
+    int index; // star index or into MapView::fleets
+    float x0, y0, x1, y1;
+  };
 
-struct Observations;
-struct Observer;
+  int columns = 0, rows = 0;
+  std::vector<Item> items;
+  std::vector<std::vector<int>> cells; // items by cell, in the order they were added
 
-struct FleetTrace {
-  FleetTrace(float _x, float _y, float _r) { x = _x; y = _y; r = _r; }
-  float x, y, r;
-};
+  void reset(float sx, float sy) {
+    columns = sx / cell + 1;
+    rows = sy / cell + 1;
+    cells.resize(columns * rows);
+    for(auto&& c : cells) { c.clear(); }
+    items.clear();
+  }
 
-struct Fleet {
-  int id;
-  float x, y;
-  float t; // -1 if in star system
-  float velocity;
-  float distance;
-  bool moving;
-
-  std::shared_ptr<Star> source;
-  std::shared_ptr<Star> destination;
-  std::weak_ptr<Observer> owner;
-
-  std::vector<FleetTrace> trace;
-  std::vector<std::weak_ptr<Star>> path; // the path we're on
-
-  const char *name;
-
-  Fleet(const Fleet * const other) {
-    id = other->id;
-    x = other->x;
-    y = other->y;
-    t = other->t;
-    velocity = other->velocity;
-    distance = other->distance;
-    moving = other->moving;
-    source = other->source;
-    destination = other->destination;
-    trace = other->trace;
-    name = other->name;
-    owner = other->owner;
-    path = other->path;
-  }
-
-  Fleet(const char *_name, std::shared_ptr<Star> s, std::weak_ptr<Observer> _owner) {
-    name = _name;
-    source = s;
-    x = source->x;
-    y = source->y;
-    destination = source;
-    t = -1;
-    moving = false;
-    owner = _owner;
-    velocity = 0.75;
-  }
-
-  void draw(float offx, float offy) {
-    if(moving == false) {
-      return;
+  void add(Kind kind, int index, float x0, float y0, float x1, float y1) {
+    int c0 = std::max(0.0f, x0 / cell), c1 = std::min((float)columns - 1, x1 / cell);
+    int r0 = std::max(0.0f, y0 / cell), r1 = std::min((float)rows - 1, y1 / cell);
+    if(x1 < 0 or y1 < 0 or c0 > c1 or r0 > r1) {
+      return; // off screen
     }
-
-    al_draw_line(source->x - offx, source->y - offy, destination->x - offx, destination->y - offy, al_map_rgb(200, 20, 20), 3);
-    al_draw_filled_circle(x - offx, y - offy, 10, al_map_rgb(200, 20, 20));
-
-    for(auto&& t : trace) {
-      al_draw_circle(t.x - offx, t.y - offy, t.r * PX_PER_LIGHTYEAR, c_steelblue, 2);
-      al_draw_filled_circle(t.x - offx, t.y - offy, 5, c_steelblue);
+    for(int r = r0; r <= r1; r++) {
+      for(int c = c0; c <= c1; c++) {
+	cells[r * columns + c].push_back(items.size());
+      }
     }
+    items.push_back(Item { kind, index, x0, y0, x1, y1 });
+  }
 
-    ImGui::SetNextWindowPos(ImVec2(x - offx - 20, y - offy - 20));
-    ImGui::SetNextWindowSize(ImVec2(40, 40));
-    ImGui::PushStyleVar(ImGuiStyleVar_Alpha, 0.01);
-    ImGui::Begin(name, NULL,
-		 ImGuiWindowFlags_NoTitleBar |
-		 ImGuiWindowFlags_NoResize |
-		 ImGuiWindowFlags_NoMove |
-		 ImGuiWindowFlags_NoScrollbar |
-		 ImGuiWindowFlags_NoBringToFrontOnFocus);
-    ImGui::InvisibleButton(name, ImVec2(40, 40));
-
-    bool hovered = ImGui::IsItemHovered();
-    ImGui::End();
-    ImGui::PopStyleVar();
-
-    if(hovered == true) {
-      ImGui::BeginTooltip();
-      ImGui::Text("%s", name);
-      ImGui::Separator();
-      ImGui::Text("Source: %s", source->name);
-      ImGui::Text("Destination: %s", destination->name);
-      ImGui::Text("Mass: 50kt");
-      ImGui::Text("Speed: %.2fc", velocity);
-      ImGui::EndTooltip();
+  // the last item added whose box holds (x, y), drawn on top of the others
+  const Item *at(float x, float y) const {
+    if(x < 0 or y < 0 or x >= columns * cell or y >= rows * cell) {
+      return nullptr;
     }
+    const Item *hit = nullptr;
+    for(int i : cells[(int)(y / cell) * columns + (int)(x / cell)]) {
+      const Item& item = items[i];
+      if(x >= item.x0 and x < item.x1 and y >= item.y0 and y < item.y1) {
+	hit = &item;
+      }
+    }
+    return hit;
   }
-
-  void move_to(const StarGraph &g, std::shared_ptr<Star>& d);
-  void update();
 };
 
-static inline const char *get_fleet_name(const Fleet& f) {
-  return f.name;
-}
-
-struct Game;
+// The part of the map on screen, in world pixels
+struct ViewRect {
+  float x0, y0, x1, y1;
 
-struct Fleets {
-  int max_id = 0;
-  std::vector<std::shared_ptr<Fleet>> fleets;
-  std::mutex add_locker;
-
-  Fleets() {
-    fleets.reserve(128);
+  bool holds(float x, float y, float margin) const {
+    return x >= x0 - margin and x <= x1 + margin and y >= y0 - margin and y <= y1 + margin;
   }
 
-  void add(Fleet&& f) {
-    add_locker.lock();
-    f.id = max_id;
-    fleets.emplace_back(std::make_shared<Fleet>(f));
-    printf("new fleet with id: %d\n", max_id);
-    max_id++;
-    add_locker.unlock();
+  bool overlaps(float ax0, float ay0, float ax1, float ay1) const {
+    return ax1 >= x0 and ax0 <= x1 and ay1 >= y0 and ay0 <= y1;
   }
 
-  void update(Observations& obs, Game& g);
-};
-
-struct Observer {
-  int id;
-  const char *name;
-  std::shared_ptr<Star> home;
-  ALLEGRO_COLOR color;
-
-  // These are *copies*
-  std::vector<std::shared_ptr<Fleet>> known_travelling_fleets;
-  std::vector<std::shared_ptr<Fleet>> known_idle_fleets;
-  std::vector<std::shared_ptr<Star>> known_stars;
-
-  std::vector<ObservableEvent> seen_events;
-
-  Observer() {
-    known_travelling_fleets.reserve(64);
-    known_idle_fleets.reserve(64);
-    known_stars.reserve(64);
-    seen_events.reserve(128);
-  }
-
-  void add_stars(const std::vector<std::shared_ptr<Star>>& stars) {
-    for(auto&& star : stars) {
-      known_stars.emplace_back(std::make_shared<Star>(*star));
-    }
+  // whether a circle of radius r drawn thickness wide crosses the screen
+  bool crosses_circle(float x, float y, float r, float thickness) const {
+    float nx = std::max(x0, std::min(x, x1)) - x, ny = std::max(y0, std::min(y, y1)) - y;
+    float fx = std::max(x - x0, x1 - x), fy = std::max(y - y0, y1 - y);
+    float outer = r + thickness, inner = std::max(0.0f, r - thickness);
+    return nx * nx + ny * ny <= outer * outer and inner * inner <= fx * fx + fy * fy;
   }
+};
 
-  void add_event(const ObservableEvent& e) {
-    seen_events.emplace_back(e);
-  }
+// Stars bucketed into square cells of the map by where they are, so a
+// frame only looks at the cells the screen covers, and the hyperlanes
+// sorted by the row of cells their top end is in. Built again when stars
+// are added, connected or moved.
+struct MapIndex {
+  struct Lane {
+    int a, b; // star indexes, a < b
+  };
 
-  bool has_seen(const ObservableEvent& e) {
-    for(auto&& seen_event : seen_events) {
-      if(seen_event.id == e.id) {
-	return true;
+  bool built = false;
+  size_t builds = 0;
+  size_t stars_seen = 0;
+  size_t edits_seen = 0; // StarGraph::edits
+  float cell = 0; // world pixels
+  float min_x = 0, min_y = 0;
+  int columns = 0, rows = 0;
+  // The stars in cell c are star_in[star_start[c]] up to
+  // star_in[star_start[c + 1]]. Lanes in row r are lanes[lane_start[r]]
+  // up to lanes[lane_start[r + 1]].
+  std::vector<int> star_start, star_in;
+  std::vector<int> lane_start;
+  std::vector<Lane> lanes;
+  float lane_height = 0; // of the tallest lane
+
+  int column(float x) const { return std::max(0, std::min(columns - 1, (int)std::max(-1.0f, (x - min_x) / cell))); }
+  int row(float y) const { return std::max(0, std::min(rows - 1, (int)std::max(-1.0f, (y - min_y) / cell))); }
+
+  void update(const Stars& stars) {
+    if(built == false or stars.stars.size() != stars_seen or stars.graph.edits.size() != edits_seen) {
+      build(stars);
+    }
+  }
+
+  void build(const Stars& stars) {
+    built = true;
+    builds++;
+    stars_seen = stars.stars.size();
+    edits_seen = stars.graph.edits.size();
+
+    float max_x = 0, max_y = 0;
+    min_x = min_y = 0;
+    if(not stars.stars.empty()) {
+      min_x = max_x = stars.stars[0]->x;
+      min_y = max_y = stars.stars[0]->y;
+    }
+    for(auto&& star : stars.stars) {
+      min_x = std::min(min_x, star->x);
+      min_y = std::min(min_y, star->y);
+      max_x = std::max(max_x, star->x);
+      max_y = std::max(max_y, star->y);
+    }
+    // a few stars to a cell
+    float w = std::max(1.0f, max_x - min_x), h = std::max(1.0f, max_y - min_y);
+    cell = std::max(64.0f, 2 * sqrtf(w * h / std::max<size_t>(1, stars_seen)));
+    columns = w / cell + 1;
+    rows = h / cell + 1;
+    size_t cells = columns * rows;
+
+    star_start.assign(cells + 1, 0);
+    for(auto&& star : stars.stars) {
+      star_start[row(star->y) * columns + column(star->x) + 1]++;
+    }
+    for(size_t c = 0; c < cells; c++) {
+      star_start[c + 1] += star_start[c];
+    }
+    star_in.resize(stars_seen);
+    std::vector<int> fill(star_start.begin(), star_start.end() - 1);
+    for(auto&& star : stars.stars) {
+      star_in[fill[row(star->y) * columns + column(star->x)]++] = star->index;
+    }
+
+    // each lane once, counted into its row and then placed
+    lane_start.assign(rows + 1, 0);
+    lane_height = 0;
+    for(int pass = 0; pass < 2; pass++) {
+      for(auto&& star : stars.stars) {
+	for(auto&& neighbor : star->neighbors) {
+	  auto n = neighbor.lock();
+	  if(not n or star->index > n->index) {
+	    continue;
+	  }
+	  int r = row(std::min(star->y, n->y));
+	  if(pass == 0) {
+	    lane_start[r + 1]++;
+	    lane_height = std::max(lane_height, fabsf(star->y - n->y));
+	  }
+	  else {
+	    lanes[fill[r]++] = Lane { star->index, n->index };
+	  }
+	}
+      }
+      if(pass == 0) {
+	for(int r = 0; r < rows; r++) {
+	  lane_start[r + 1] += lane_start[r];
+	}
+	lanes.resize(lane_start[rows]);
+	fill.assign(lane_start.begin(), lane_start.end() - 1);
       }
     }
-    return false;
   }
 
-  void remove_event(ObservableEvent& e) {
-    auto it = seen_events.begin();
-    while(it != seen_events.end()) {
-      if(it->id == e.id) {
-	seen_events.erase(it);
-	return;
+  // Stars within margin of the view, and lanes[first] up to lanes[last],
+  // the ones that start in a row the view or a lane reaching into it
+  // could start in
+  void visible(const Stars& stars, const ViewRect& view, float margin,
+	       std::vector<int>& star_out, int& first, int& last) const {
+    star_out.clear();
+    first = last = 0;
+    if(columns == 0) {
+      return;
+    }
+    int c0 = column(view.x0 - margin), c1 = column(view.x1 + margin);
+    int r0 = row(view.y0 - margin), r1 = row(view.y1 + margin);
+    for(int r = r0; r <= r1; r++) {
+      for(int i = star_start[r * columns + c0]; i < star_start[r * columns + c1 + 1]; i++) {
+	const Star& star = *stars.stars[star_in[i]];
+	if(view.holds(star.x, star.y, margin)) {
+	  star_out.push_back(star.index);
+	}
       }
-      it++;
     }
-  }
-
-  Observer(const char *_name, const std::shared_ptr<Star>& h, ALLEGRO_COLOR c) {
-    name = _name;
-    home = h;
-    color = c;
+    if(view.y1 >= min_y and view.y0 <= min_y + rows * cell) {
+      first = lane_start[row(view.y0 - lane_height)];
+      last = lane_start[row(view.y1) + 1];
+    }
   }
 };
 
-struct MessageLog {
-  std::vector<std::string> messages;
-  int year;
+// The hyperlanes as quads in a vertex buffer, in MapIndex::lanes order,
+// made again when the index is
+struct LaneBuffer {
+  static const int vertices_per_lane = 6;
 
-  MessageLog() {
-    messages.reserve(32);
-    year = -1;
-  }
+  ALLEGRO_VERTEX_BUFFER *vb = NULL;
+  std::vector<ALLEGRO_VERTEX> fallback; // if there is no vertex buffer support
+  size_t builds_seen = 0;
 
-  void addMessage(const char *m, bool with_year = true) {
-    // keep last 32 messages
-    if(messages.size() >= 32) {
-      messages.erase(messages.begin());
+  void update(const MapIndex& index, const Stars& stars) {
+    if(builds_seen == index.builds) {
+      return;
+    }
+    builds_seen = index.builds;
+    clear();
+
+    PrimBatch lanes;
+    lanes.v.reserve(index.lanes.size() * vertices_per_lane);
+    ALLEGRO_COLOR color = al_map_rgb(200,200,200);
+    for(auto&& lane : index.lanes) {
+      const Star& a = *stars.stars[lane.a];
+      const Star& b = *stars.stars[lane.b];
+      size_t start = lanes.v.size();
+      lanes.line(a.x, a.y, b.x, b.y, 2, color);
+      // nothing if the two stars are on top of each other, the lane keeps its slot
+      lanes.v.resize(start + vertices_per_lane, ALLEGRO_VERTEX { a.x, a.y, 0, 0, 0, color });
+    }
+    if(lanes.v.empty()) {
+      return;
+    }
+    vb = al_create_vertex_buffer(NULL, lanes.v.data(), lanes.v.size(), ALLEGRO_PRIM_BUFFER_STATIC);
+    if(vb == NULL) {
+      fallback.swap(lanes.v);
     }
+  }
 
-    std::stringstream ss;
-    if(with_year == true) {
-      ss << "Year " << year << " ";
+  void clear() {
+    if(vb) {
+      al_destroy_vertex_buffer(vb);
+      vb = NULL;
     }
-    ss << m;
-    messages.emplace_back(std::move(ss.str()));
+    fallback.clear();
   }
 
-  void addEventMessage(const ObservableEvent& event) {
-    static char buf[128];
-    switch(event.type)
-      {
-      case ObservableEventType::FleetDeparture:
-	{
-	  sprintf(buf, "%s departed from %s to %s", event.fleet1->name, event.orderTarget->name, event.orderMoveTo->name);
-	};
-	break;
-      case ObservableEventType::FleetArrival:
-	{
-	  sprintf(buf, "%s arrived at %s", event.fleet1->name, event.orderMoveTo->name);
-	};
-	break;
-      case ObservableEventType::CombatReport:
-	{
-	  sprintf(buf, "%s was destroyed at %s", event.fleet1->name, event.fleet1->source->name);
-	};
-	break;
-      default:
-	{
-	  return;
-	};
-	break;
-      }
-    printf("Log message: %s\n", buf);
-    addMessage(buf);
+  // lanes first up to last, with the view's top left corner at the origin
+  void draw(int first, int last, float vx, float vy) const {
+    if(first >= last) {
+      return;
+    }
+    ALLEGRO_TRANSFORM saved, t;
+    al_copy_transform(&saved, al_get_current_transform());
+    al_identity_transform(&t);
+    al_translate_transform(&t, -vx, -vy);
+    al_compose_transform(&t, &saved);
+    al_use_transform(&t);
+    if(vb) {
+      al_draw_vertex_buffer(vb, NULL, first * vertices_per_lane, last * vertices_per_lane, ALLEGRO_PRIM_TRIANGLE_LIST);
+    }
+    else {
+      al_draw_prim(fallback.data(), NULL, NULL, first * vertices_per_lane, last * vertices_per_lane, ALLEGRO_PRIM_TRIANGLE_LIST);
+    }
+    al_use_transform(&saved);
   }
 };
 
-struct Observations {
-  std::vector<ObservableEvent> events;
-  std::vector<ObservableEvent> order_add_queue;
-
-  std::vector<std::shared_ptr<Observer>> observers;
-  std::shared_ptr<Observer> human_controller;
-
-  int max_observer_id = 0; // id's for Observers
-  int max_event_id = 0; // id's for ObservableEvents
-  int tick_events_created = 0;
-
-  Observations() {
-    events.reserve(128);
-    order_add_queue.reserve(32);
-    observers.reserve(8);
+// A part of the map that changes now and then, drawn to a bitmap the size
+// of the display and only drawn again when the view or one of the
+// versions it was drawn for changes. Without a bitmap it's drawn
+// straight to the screen every frame.
+struct Layer {
+  ALLEGRO_BITMAP *bitmap = NULL;
+  ALLEGRO_BITMAP *target = NULL; // while drawing to the bitmap
+  bool dirty = true;
+  float vx = 0, vy = 0;
+  std::vector<size_t> versions;
+
+  void check(float _vx, float _vy, std::initializer_list<size_t> _versions) {
+    if(_vx != vx or _vy != vy or versions.size() != _versions.size() or
+       not std::equal(versions.begin(), versions.end(), _versions.begin())) {
+      vx = _vx;
+      vy = _vy;
+      versions.assign(_versions);
+      dirty = true;
+    }
+  }
+
+  // True if the layer has to be drawn, to the bitmap until end()
+  bool begin(float sx, float sy) {
+    if(bitmap == NULL or al_get_bitmap_width(bitmap) != (int)sx or al_get_bitmap_height(bitmap) != (int)sy) {
+      clear();
+      bitmap = al_create_bitmap(sx, sy);
+      dirty = true;
+    }
+    if(bitmap == NULL) {
+      return true;
+    }
+    if(dirty == false) {
+      return false;
+    }
+    dirty = false;
+    target = al_get_target_bitmap();
+    al_set_target_bitmap(bitmap);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    return true;
   }
 
-  void update_star_knowledge(Observer& observer, std::shared_ptr<Star>& real_star) {
-    printf("update_star_knowledge: %s : %s\n", observer.name, real_star->name);
-    for(auto&& star : observer.known_stars) {
-      if(star->id == real_star->id) {
-	assert(strcmp(star->name, real_star->name) == 0);
-	float wx = star->wx;
-	float wy = star->wy;
-
-	star = real_star;
-
-	// the real star has never been drawn so these values weren't set
-	star->wx = wx;
-	star->wy = wy;
-	return;
-      }
+  void end() {
+    if(target) {
+      al_set_target_bitmap(target);
+      target = NULL;
     }
-    assert(false);
-  }
-
-  void addFleetDeparture(std::shared_ptr<Fleet>& f) {
-    auto ev = ObservableEvent(ObservableEventType::FleetDeparture, f->x, f->y, max_event_id);
-    max_event_id++;
-    printf("Fleet departure: %s, %s to %s\n", f->name, f->source->name, f->destination->name);
-    ev.fleet1 = std::make_shared<Fleet>(f.get());
-    ev.orderTarget = f->source;
-    ev.orderMoveTo = f->destination;
-    order_add_queue.emplace_back(std::move(ev));
-    tick_events_created++;
-  }
-
-  void addFleetArrival(std::shared_ptr<Fleet>& f) {
-    auto ev = ObservableEvent(ObservableEventType::FleetArrival, f->x, f->y, max_event_id);
-    max_event_id++;
-    printf("Fleet arrival: %s at %s\n", f->name, f->destination->name);
-    ev.fleet1 = std::make_shared<Fleet>(f.get());
-    ev.orderTarget = f->source;
-    ev.orderMoveTo = f->destination;
-    events.emplace_back(std::move(ev));
-    tick_events_created++;
-  }
-
-  void addFleetCombat(std::shared_ptr<Fleet>& f) {
-    auto ev = ObservableEvent(ObservableEventType::CombatReport, f->x, f->y, max_event_id);
-    max_event_id++;
-    printf("Fleet combat: %s died at %s\n", f->name, f->source->name);
-    ev.fleet1 = std::make_shared<Fleet>(f.get());
-    events.emplace_back(std::move(ev));
-    tick_events_created++;
-  }
-
-  void addOrderFleetMove(std::shared_ptr<Fleet>& f,
-			 std::shared_ptr<Star>& from,
-			 std::shared_ptr<Star>& to,
-			 std::shared_ptr<Observer>& o) {
-    float x = human_controller->home->x;
-    float y = human_controller->home->y;
-
-    auto ev = ObservableEvent(ObservableEventType::OrderFleetMove, x, y, max_event_id);
-    max_event_id++;
-    ev.fleet1 = std::make_shared<Fleet>(f.get());
-    ev.orderTarget = from;
-    ev.orderMoveTo = to;
-    ev.orderSender = o;
-    events.emplace_back(std::move(ev));
-    tick_events_created++;
-  }
-
-  void add(Observer&& o) {
-    o.id = max_observer_id;
-    max_observer_id++;
-    observers.emplace_back(std::make_shared<Observer>(o));
-  }
-
-  bool orderReachedDestination(const ObservableEvent& event) {
-    float distance_squared =
-      (event.x - event.orderTarget->x) * (event.x - event.orderTarget->x) +
-      (event.y - event.orderTarget->y) * (event.y - event.orderTarget->y);
-
-    float wave_distance_squared =
-      event.t * event.t * PX_PER_LIGHTYEAR * PX_PER_LIGHTYEAR;
-
-    return distance_squared <= wave_distance_squared;
-  }
-
-  bool eventReachedObserver(const Observer& observer, const ObservableEvent& event) {
-    float distance_squared =
-      (event.x - observer.home->x) * (event.x - observer.home->x) +
-      (event.y - observer.home->y) * (event.y - observer.home->y);
-    float wave_distance_squared =
-      event.t * event.t * PX_PER_LIGHTYEAR * PX_PER_LIGHTYEAR;
-
-    return distance_squared <= wave_distance_squared;
-  }
-
-  std::shared_ptr<Fleet> orderTargetIsPresent(Fleets& fleets, const ObservableEvent& event) {
-    std::shared_ptr<Fleet> ret;
-    for(auto&& fleet : fleets.fleets) {
-      if(fleet->id == event.fleet1->id) {
-	if(fleet->moving == false and
-	   fleet->destination->id == event.orderTarget->id and
-	   fleet->source->id == event.orderTarget->id)
-	  {
-	    return fleet;
-	  }
-      }
-    }
-    return NULL;
   }
 
-  bool processOrder(const StarGraph& g, Fleets& fleets, ObservableEvent& event, Observer& observer) {
-    if(not orderReachedDestination(event)) {
-      return false;
+  void draw() const {
+    if(bitmap) {
+      al_draw_bitmap(bitmap, 0, 0, 0);
     }
-    if(observer.has_seen(event)) {
-      return true;
+  }
+
+  void clear() {
+    if(bitmap) {
+      al_destroy_bitmap(bitmap);
+      bitmap = NULL;
     }
+  }
+};
 
-    std::shared_ptr<Fleet> f = orderTargetIsPresent(fleets, event);
+// Event wavefronts and fleet traces, the rings of them that cross the
+// screen collected over a frame and then tessellated into one batch, only
+// the arc that can be on screen. Past max_rings of them that's more
+// triangles than is worth it and they're drawn as a heatmap of how many
+// rings cross each heat_cell square instead.
+struct RingRenderer {
+  static const size_t max_rings = 2000;
+  static const int heat_cell = 16;
+
+  struct Ring {
+    float x, y, r; // screen
+    ALLEGRO_COLOR color;
+  };
 
-    if(f) {
-      printf("%s received order to move to %s\n", f->name, event.orderMoveTo->name);
-      f->move_to(g, event.orderMoveTo);
-      addFleetDeparture(f);
+  PrimBatch batch;
+  std::vector<Ring> rings;
+  std::vector<int> heat; // by cell
+  std::vector<uint32_t> heat_ring; // the last ring counted in a cell
+  bool heatmap = false; // last frame
+
+  void add(float x, float y, float r, ALLEGRO_COLOR color) {
+    rings.push_back(Ring { x, y, r, color });
+  }
+
+  // The arc of a ring inside the circle around the screen, false if there
+  // is none
+  static bool visible_arc(const Ring& ring, float sx, float sy, float& a0, float& span) {
+    float cx = sx / 2, cy = sy / 2, d = sqrtf(cx * cx + cy * cy) + heat_cell;
+    float dx = cx - ring.x, dy = cy - ring.y;
+    float dist = sqrtf(dx * dx + dy * dy);
+    if(ring.r + dist <= d) {
+      a0 = 0;
+      span = 2 * M_PI;
+      return true;
     }
-    else {
-      printf("order failed\n");
+    if(fabsf(ring.r - dist) >= d) {
+      return false;
     }
-
-    observer.add_event(event);
+    float half = acosf(std::max(-1.0f, std::min(1.0f, (ring.r * ring.r + dist * dist - d * d) / (2 * ring.r * dist))));
+    a0 = atan2f(dy, dx) - half;
+    span = 2 * half;
     return true;
   }
 
-  bool RemoveFleetInVector(std::vector<std::shared_ptr<Fleet>>& vec,
-			   const std::shared_ptr<Fleet>& fleet) {
-    auto it = vec.begin();
-    while(it != vec.end()) {
-      if((*it)->id == fleet->id) {
-	vec.erase(it);
-	return true;
+  void draw(float sx, float sy, float thickness) {
+    heatmap = rings.size() > max_rings;
+    if(heatmap == false) {
+      for(auto&& ring : rings) {
+	float a0, span;
+	if(visible_arc(ring, sx, sy, a0, span)) {
+	  batch.arc(ring.x, ring.y, ring.r, thickness, a0, span, ring.color);
+	}
       }
-      it++;
     }
-    printf("RemoveFleetInVector: false\n");
-    return false;
-  }
-
-  bool FleetEventInVector(const std::vector<std::shared_ptr<Fleet>>& vec,
-			  const ObservableEvent& event) {
-    auto it = vec.begin();
-    while(it != vec.end()) {
-      if((*it)->id == event.fleet1->id) {
-	return true;
+    else {
+      draw_heatmap(sx, sy);
+    }
+    batch.draw();
+    rings.clear();
+  }
+
+  // walks each ring's visible arc a cell at a time
+  void draw_heatmap(float sx, float sy) {
+    int columns = sx / heat_cell + 1, rows = sy / heat_cell + 1;
+    heat.assign(columns * rows, 0);
+    heat_ring.assign(columns * rows, UINT32_MAX);
+    int most = 0;
+    for(uint32_t i = 0; i < rings.size(); i++) {
+      const Ring& ring = rings[i];
+      float a0, span;
+      if(not visible_arc(ring, sx, sy, a0, span)) {
+	continue;
+      }
+      int steps = std::max(1.0f, ring.r * span / (heat_cell / 2));
+      for(int k = 0; k <= steps; k++) {
+	float a = a0 + span * k / steps;
+	float x = ring.x + ring.r * cosf(a), y = ring.y + ring.r * sinf(a);
+	if(x < 0 or y < 0 or x >= sx or y >= sy) {
+	  continue;
+	}
+	int c = (int)(y / heat_cell) * columns + (int)(x / heat_cell);
+	if(heat_ring[c] != i) {
+	  heat_ring[c] = i;
+	  most = std::max(most, ++heat[c]);
+	}
       }
-      it++;
     }
-    return false;
-  }
-
-  bool RemoveFleetEventInVector(std::vector<std::shared_ptr<Fleet>>& vec,
-				const ObservableEvent& event) {
-    auto it = vec.begin();
-    while(it != vec.end()) {
-      if((*it)->id == event.fleet1->id) {
-	vec.erase(it);
-	return true;
+    for(int r = 0; r < rows; r++) {
+      for(int c = 0; c < columns; c++) {
+	int h = heat[r * columns + c];
+	if(h == 0) {
+	  continue;
+	}
+	// premultiplied, like allegro blends by default
+	float alpha = 0.2 + 0.6 * logf(1 + h) / logf(1 + most);
+	ALLEGRO_COLOR color = al_map_rgba_f(0.4 * alpha, 0.4 * alpha, alpha, alpha);
+	float x = c * heat_cell, y = r * heat_cell;
+	batch.quad(x, y, x + heat_cell, y, x + heat_cell, y + heat_cell, x, y + heat_cell, color);
       }
-      it++;
     }
-    printf("RemoveFleetEventInVector: false\n");
-    return false;
   }
+};
 
-  bool processEvent(Observer& observer, ObservableEvent& event, MessageLog& log) {
-    if(not eventReachedObserver(observer, event)) {
-      return false;
-    }
-    if(observer.has_seen(event)) {
-      return true;
-    }
+// The map as batched primitives and star labels in one ImGui draw list,
+// only what's on screen. Stars and fleets go into hits as they're drawn
+// and ImGui is only asked for the tooltip or the menu of the one under
+// the mouse. The background, the stars' owners and the lanes are layers
+// under everything else, which moves too often to be worth keeping.
+struct MapView {
+  Layer background_layer;
+  Layer territory_layer;
+  Layer lane_layer;
+  PrimBatch batch;
+  HitGrid hits;
+  MapIndex index;
+  LaneBuffer lanes;
+  RingRenderer rings;
+  std::vector<int> stars; // on screen this frame
+  int first_lane = 0, last_lane = 0;
+
+  // forget the map drawn before, when another game is loaded
+  void reset() {
+    background_layer.clear();
+    territory_layer.clear();
+    lane_layer.clear();
+    lanes.clear();
+    *this = MapView();
+  }
+  std::vector<FleetState> fleets; // travelling fleets where they were drawn
+  std::weak_ptr<Star> menu_star; // the star menu is open for
+  std::weak_ptr<Star> carried; // being moved in the editor, follows the mouse until dropped
+};
 
-    switch(event.type)
-      {
-      case ObservableEventType::FleetArrival:
-	{
-	  if(not FleetEventInVector(observer.known_idle_fleets, event)) {
-	    // we haven't seen this even before
-	    std::shared_ptr<Fleet> fleet_copy(new Fleet(event.fleet1.get()));
-	    observer.known_idle_fleets.emplace_back(std::move(fleet_copy));
-	    if(observer.id == event.fleet1->owner.lock()->id) {
-	      update_star_knowledge(observer, event.fleet1->destination);
-	    }
-	    printf("Observer %s saw fleet \"%s\" arrive\n", observer.name, event.fleet1->name);
-	    if(observer.id == human_controller->id) {
-	      log.addEventMessage(event);
-	    }
-	    RemoveFleetEventInVector(observer.known_travelling_fleets, event);
-	  }
-	};
-	break;
-
-      case ObservableEventType::FleetDeparture:
-	{
-	  if(not FleetEventInVector(observer.known_travelling_fleets, event)) {
-	    // we haven't seen this even before
-	    std::shared_ptr<Fleet> fleet_copy(new Fleet(event.fleet1.get()));
-	    observer.known_travelling_fleets.emplace_back(std::move(fleet_copy));
-	    printf("Observer %s saw fleet \"%s\" depart\n", observer.name, event.fleet1->name);
-	    if(observer.id == event.fleet1->owner.lock()->id) {
-	      update_star_knowledge(observer, event.orderTarget);
-	    }
-	    if(observer.id == human_controller->id) {
-	      log.addEventMessage(event);
-	    }
-	    RemoveFleetEventInVector(observer.known_idle_fleets, event);
-	  }
-	};
-	break;
-
-      case ObservableEventType::CombatReport:
-	if(FleetEventInVector(observer.known_idle_fleets, event)) {
-	  // can the arrival event come after the combat report?
-	  printf("Observer %s saw fleet \"%s\" destroyed at %s\n", observer.name, event.fleet1->name, event.fleet1->source->name);
-	  if(observer.id == event.fleet1->owner.lock()->id) {
-	    update_star_knowledge(observer, event.fleet1->source);
-	  }
-	  if(observer.id == human_controller->id) {
-	    log.addEventMessage(event);
-	  }
-	  RemoveFleetEventInVector(observer.known_idle_fleets, event);
-	}
-	break;
+MapView g_map;
 
-      default:
-	{
-	};
-	break;
-      }
+// star labels look like the buttons in their own windows they used to be
+const float LABEL_PAD_X = 12;
+const float LABEL_PAD_Y = 11;
+const float LABEL_INSET = 8;
+// how far off screen a star can be and still have its label or idle
+// fleets show
+const float STAR_MARGIN = 128;
 
-    observer.add_event(event);
-    return true;
+// known is the last state we heard of, drawn where it would be by now
+static void draw_fleet(MapView& map, const ViewRect& view, const FleetState& known, int ticks) {
+  FleetState fleet = known.at(ticks);
+  if(fleet.moving == false) {
+    return;
   }
 
-  void update(const StarGraph& graph, Fleets& fleets, MessageLog& log) {
-    std::vector<ObservableEvent>::iterator it = events.begin();
-
-    while(it != events.end()) {
-
-      ObservableEvent& event = *it;
-      bool erase_event = true;
-      event.t += 1;
-
-      switch(event.type)
-	{
-	case ObservableEventType::OrderFleetMove:
-	  {
-	    // orders are erased when they reach the target star
-	    erase_event = processOrder(graph, fleets, event, *human_controller);
-	  };
-	  break;
-
-	default:
-	  {
-	    for(auto&& observer : observers) {
-	      bool reached = processEvent(*observer, event, log);
-	      // other events propagate until they reach all observers
-	      erase_event = erase_event && reached;
-	    }
-	  };
-	  break;
-	}
+  float offx = view.x0, offy = view.y0;
+  const Star& from = *fleet.source;
+  const Star& to = *fleet.destination;
+  ALLEGRO_COLOR red = al_map_rgb(200, 20, 20);
+  if(view.overlaps(std::min(from.x, to.x), std::min(from.y, to.y), std::max(from.x, to.x), std::max(from.y, to.y))) {
+    map.batch.line(from.x - offx, from.y - offy, to.x - offx, to.y - offy, 3, red);
+  }
 
-      if(erase_event == true) {
-	for(auto&& observer : observers) { observer->remove_event(event); }
-	it = events.erase(it);
+  if(g_draw_fleet_traces == true) {
+    FleetTrace trace;
+    known.trace(ticks, trace);
+    for(int i = 0; i < trace.size(); i++) {
+      const FleetTrace::Sample& t = trace[i];
+      float r = (ticks - t.tick) * PX_PER_LIGHTYEAR;
+      if(view.crosses_circle(t.x, t.y, r, 2)) {
+	map.rings.add(t.x - offx, t.y - offy, r, c_steelblue);
+      }
+      if(view.holds(t.x, t.y, 5)) {
+	map.batch.disc(t.x - offx, t.y - offy, 5, c_steelblue);
       }
-      else { it++; }
     }
+  }
 
-    for(auto&& order : order_add_queue) {
-      events.emplace_back(std::move(order));
-    }
-    order_add_queue.clear();
+  if(view.holds(fleet.x, fleet.y, 20)) {
+    map.batch.disc(fleet.x - offx, fleet.y - offy, 10, red);
+    float x = fleet.x - offx, y = fleet.y - offy;
+    map.hits.add(HitGrid::Kind::Fleet, map.fleets.size(), x - 20, y - 20, x + 20, y + 20);
+    map.fleets.push_back(fleet);
   }
+}
 
-  void draw(float offx, float offy, bool show_event_circles) {
-    if(show_event_circles == true) {
-      for(auto&& event : events) {
-	al_draw_filled_circle(event.x - offx, event.y - offy, 5, al_map_rgb(100, 100, 255));
-	al_draw_circle(event.x - offx, event.y - offy, event.t * PX_PER_LIGHTYEAR, al_map_rgb(100, 100, 255), 2);
+static void draw_observations(MapView& map, const ViewRect& view, const Observations& obs, bool show_event_circles) {
+  float offx = view.x0, offy = view.y0;
+  ALLEGRO_COLOR blue = al_map_rgb(100, 100, 255);
+  if(show_event_circles == true) {
+    for(auto&& h : obs.events.live) {
+      float x = obs.events.x[h];
+      float y = obs.events.y[h];
+      float r = obs.age(h) * PX_PER_LIGHTYEAR;
+      if(view.holds(x, y, 5)) {
+	map.batch.disc(x - offx, y - offy, 5, blue);
+      }
+      if(view.crosses_circle(x, y, r, 2)) {
+	map.rings.add(x - offx, y - offy, r, blue);
       }
-    }
-
-    for(auto fleet : human_controller->known_travelling_fleets) {
-      fleet->draw(offx, offy);
     }
   }
-};
 
-const char *get_observer_name(const Observer& o) {
-  return o.name;
+  map.fleets.clear();
+  for(auto fleet : obs.human_controller->known_travelling_fleets) {
+    draw_fleet(map, view, *fleet, obs.fleet_ticks);
+  }
+  // the rings under the fleets
+  map.rings.draw(view.x1 - view.x0, view.y1 - view.y0, 2);
+  map.batch.draw();
 }
 
-struct Stars {
-  int max_id = 0;
-  const size_t max_stars = 128;
-  std::vector<std::shared_ptr<Star>> stars;
-  StarGraph graph;
-
-  ALLEGRO_BITMAP *circle_buf;
-
-  Stars() {
-    stars.reserve(64);
+static void draw_star_graph(MapView& map, const Stars& stars, float offx, float offy, float sx, float sy) {
+  map.lanes.update(map.index, stars);
+  map.lane_layer.check(offx, offy, { map.lanes.builds_seen });
+  if(map.lane_layer.begin(sx, sy)) {
+    map.lanes.draw(map.first_lane, map.last_lane, offx, offy);
+    map.lane_layer.end();
   }
+  map.lane_layer.draw();
+}
 
-  ~Stars() {
-    for(auto&& star : stars) { free(star->name); }
+static void draw_background(MapView& map, ALLEGRO_BITMAP *bg, float sx, float sy) {
+  map.background_layer.check(0, 0, {});
+  if(map.background_layer.begin(sx, sy)) {
+    al_draw_scaled_bitmap(bg, 0, 0, al_get_bitmap_width(bg), al_get_bitmap_height(bg), 0, 0, sx, sy, 0);
+    map.background_layer.end();
   }
+  map.background_layer.draw();
+}
 
-  void update() {
-    for(auto&& star : stars) { star->update(); }
+// where a star is drawn, the one being moved is under the mouse
+static ImVec2 star_on_screen(const Star& star, float vx, float vy) {
+  if(star.moving == true) {
+    return ImGui::GetIO().MousePos;
   }
+  return ImVec2(star.x - vx, star.y - vy);
+}
 
-  void add(const char *name) {
-    add(name, 0, 0);
+static void draw_stars(MapView& map, const ViewRect& view, const Stars& stars, const Observer& o) {
+  float vx = view.x0, vy = view.y0;
+  map.index.update(stars);
+  map.index.visible(stars, view, STAR_MARGIN, map.stars, map.first_lane, map.last_lane);
+  map.territory_layer.check(vx, vy, { map.index.builds, (size_t)&o, o.star_changes });
+  // the one being moved is wherever the mouse is
+  if(std::shared_ptr<Star> carried = map.carried.lock()) {
+    if(std::find(map.stars.begin(), map.stars.end(), carried->index) == map.stars.end()) {
+      map.stars.push_back(carried->index);
+    }
+    map.territory_layer.dirty = true;
   }
 
-  void add(const char *name, float _x, float _y) {
-    stars.emplace_back(std::make_shared<Star>(Star(name, _x, _y, max_id)));
-    max_id++;
-    printf("stars.size(): %ld\n", stars.size());
+  for(int i : map.stars) {
+    Star& star = *stars.stars[i];
+    if(star.wx == 0) {
+      ImVec2 size = ImGui::CalcTextSize(star.name);
+      star.wx = size.x + 2 * LABEL_PAD_X;
+      star.wy = size.y + 2 * LABEL_PAD_Y;
+    }
   }
 
-  std::shared_ptr<Star> from_name(const char *name) {
-    std::shared_ptr<Star> ret;
-    for(auto&& star : stars) {
-      if(strcmp(star->name, name) == 0) {
-	ret = star;
-	break;
+  if(map.territory_layer.begin(view.x1 - vx, view.y1 - vy)) {
+    for(int i : map.stars) {
+      const std::shared_ptr<Star>& star = stars.stars[i];
+      if(auto s = o.known(*star).owner.lock()) {
+	ImVec2 p = star_on_screen(*star, vx, vy);
+	map.batch.disc(p.x, p.y, star->wx/1.8, al_color(s->color));
       }
     }
-    return ret;
+    map.batch.draw();
+    map.territory_layer.end();
   }
+  map.territory_layer.draw();
 
-  void connect(const char *name1, const char *name2) {
-    graph.add(from_name(name1), from_name(name2));
-  }
-
-  void rebuild_indexes() {
-    int i = 0;
-    for(auto&& star : stars) {
-      star->index = i;
-      i++;
+  ImDrawList *labels = ImGui::GetWindowDrawList();
+  ImU32 box = ImGui::ColorConvertFloat4ToU32(ImVec4(0.2, 0.2, 0.2, 1.0));
+  ImU32 text = ImGui::ColorConvertFloat4ToU32(ImVec4(1.0, 1.0, 1.0, 1.0));
+  for(int i : map.stars) {
+    const std::shared_ptr<Star>& star = stars.stars[i];
+    ImVec2 p = star_on_screen(*star, vx, vy);
+    float x0 = p.x - star->wx/2, y0 = p.y - star->wy/2;
+    float x1 = x0 + star->wx, y1 = y0 + star->wy;
+    if(x1 < 0 or y1 < 0 or x0 > view.x1 - vx or y0 > view.y1 - vy) {
+      continue;
     }
+    labels->AddRectFilled(ImVec2(x0 + LABEL_INSET, y0 + LABEL_INSET), ImVec2(x1 - LABEL_INSET, y1 - LABEL_INSET), box);
+    labels->AddText(ImVec2(x0 + LABEL_PAD_X, y0 + LABEL_PAD_Y), text, star->name);
+    map.hits.add(HitGrid::Kind::Star, star->index, x0, y0, x1, y1);
   }
 
-  void init() {
-    circle_buf = al_create_bitmap(720, 480);
-    assert(circle_buf);
-
-    stars.reserve(max_stars);
-
-    add("Sol", 100, 100);
-    add("Procyon", 250, 0);
-    add("Epsilon Eridani", 400, 200);
-    add("Tau Ceti", 200, 150);
-    add("Lalande", 90, 250);
-    add("Alpha Centauri", -60, 130);
-    add("Ross 154", -130, 240);
-    add("Cygni", -70, -50);
-    rebuild_indexes();
-
-    std::shared_ptr<Star> sol = from_name("Sol");
-    std::shared_ptr<Star> procyon = from_name("Procyon");
-    std::shared_ptr<Star> epsiloneridani = from_name("Epsilon Eridani");
-    std::shared_ptr<Star> tauceti = from_name("Tau Ceti");
-    std::shared_ptr<Star> lalande = from_name("Lalande");
-    std::shared_ptr<Star> alphacentauri = from_name("Alpha Centauri");
-    std::shared_ptr<Star> ross154 = from_name("Ross 154");
-    std::shared_ptr<Star> cygni = from_name("Cygni");
-
-    graph.s = this;
-    graph.add(sol, tauceti);
-    graph.add(tauceti, lalande);
-    graph.add(tauceti, epsiloneridani);
-    graph.add(sol, procyon);
-    graph.add(procyon, tauceti);
-    graph.add(sol, alphacentauri);
-    graph.add(alphacentauri, ross154);
-    graph.add(alphacentauri, cygni);
-    graph.add(alphacentauri, lalande);
-    graph.add(sol, lalande);
-    graph.add(sol, cygni);
-
-    auto path = graph.pathfind(epsiloneridani, ross154);
-    for(auto&& next : path) {
-      printf("-> %s\n", next.lock()->name);
-    }
-  }
-
-  void draw(float vx, float vy, const Observer& o) {
-    for(auto&& star : o.known_stars) {
-      if(auto s = star->owner.lock()) {
-	al_draw_filled_circle(star->x - vx, star->y - vy, star->wx/1.8, s->color);
-      }
-    }
-
-    ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.2, 0.2, 0.2, 1.0));
-    for(auto&& star : o.known_stars) {
-      star->draw(vx, vy, o);
-    }
-    ImGui::PopStyleColor();
-    graph.draw(vx, vy);
+  draw_star_graph(map, stars, vx, vy, view.x1 - vx, view.y1 - vy);
 
-    for(auto&& fleet : o.known_idle_fleets) {
+  const DockIndex& idle = o.idle_by_star();
+  for(int s : map.stars) {
+    for(int i = idle.first(s); i != DockIndex::none; i = idle.next[i]) {
+      auto& fleet = o.known_idle_fleets[i];
       if(auto f = fleet->owner.lock()) {
-	al_draw_filled_circle(fleet->source->x - vx, fleet->source->y - vy - 35, 10, f->color);
-	al_draw_circle(fleet->source->x - vx, fleet->source->y - vy - 35, 10, al_map_rgb(255, 255, 255), 2);
+	map.batch.disc(fleet->source->x - vx, fleet->source->y - vy - 35, 11, al_map_rgb(255, 255, 255));
+	map.batch.disc(fleet->source->x - vx, fleet->source->y - vy - 35, 9, al_color(f->color));
       }
     }
   }
-};
-
-void StarGraph::add(const std::shared_ptr<Star>& s1, const std::shared_ptr<Star>& s2) {
-  s1->neighbors.emplace_back(s2);
-  s2->neighbors.emplace_back(s1);
+  map.batch.draw();
 }
 
-void StarGraph::draw(float offx, float offy) {
-  for(auto&& star : s->stars) {
-    for(auto&& neighbor : star->neighbors) {
-      if(auto n = neighbor.lock()) {
-	al_draw_line(star->x - offx, star->y - offy, n->x - offx, n->y - offy, al_map_rgb(200,200,200), 2);
-      }
+static void star_tooltip(const Star& star, const Observer& viewer) {
+  ImGui::BeginTooltip();
+  ImGui::Text("%s", star.name);
+  float distance = distance_to_star(viewer, star);
+  if(distance > 0.1) {
+    ImGui::Separator();
+    ImGui::Text("Distance: %.1fly", distance);
+  }
+  if(auto o = viewer.known(star).owner.lock()) {
+    if(distance < 0.1) {
+      ImGui::Separator();
     }
+    ImGui::Text("Owner: %s", get_observer_name(*o));
   }
+  ImGui::EndTooltip();
 }
 
-std::vector<std::weak_ptr<Star>> StarGraph::pathfind(const std::shared_ptr<Star>& from, const std::shared_ptr<Star>& to) const {
-  struct bfsdata {
-    std::weak_ptr<Star> parent;
-  };
-
-  std::vector<bfsdata> data(s->stars.size());
-
-  std::deque<std::weak_ptr<Star>> q;
-  q.emplace_back(from);
-
-  while(not q.empty()) {
-    std::weak_ptr<Star> cur_ = q.front();
-    auto cur = cur_.lock();
-    if(not cur) { continue; }
-
-    q.pop_front();
+static void fleet_tooltip(const FleetState& fleet) {
+  ImGui::BeginTooltip();
+  ImGui::Text("%s", fleet.name);
+  ImGui::Separator();
+  ImGui::Text("Source: %s", fleet.source->name);
+  ImGui::Text("Destination: %s", fleet.destination->name);
+  ImGui::Text("Mass: 50kt");
+  ImGui::Text("Speed: %.2fc", fleet.velocity);
+  ImGui::EndTooltip();
+}
 
-    for(auto&& neighbor_ : cur->neighbors) {
-      auto neighbor = neighbor_.lock();
-      if(not neighbor) { continue; }
-      bool not_visited = not data[neighbor->index].parent.lock();
+static void star_menu(MapView& map, const Observer& viewer) {
+  if(not ImGui::BeginPopup("star menu")) {
+    return;
+  }
+  if(std::shared_ptr<Star> star = map.menu_star.lock()) {
+    if(g_star_moving == true) {
+      if(ImGui::Button("Connect")) {
+	if(g_selected_star1.lock()) {
+	  g_selected_star2 = star;
+	}
+	else {
+	  g_selected_star1 = star;
+	}
+      }
 
-      if(not_visited == true) {
-	data[neighbor->index].parent = cur;
-	q.push_back(neighbor);
+      if(ImGui::Button("Move")) {
+	star->moving = true;
+	map.carried = star;
+	ImGui::CloseCurrentPopup();
       }
     }
-  }
 
-  if(not data[to->index].parent.lock()) { return {}; } // no path
-
-  std::vector<std::weak_ptr<Star>> ret;
-  std::shared_ptr<Star> cur = to;
+    ImGui::PushItemWidth(300);
+    ImGui::Columns(2);
+    ImGui::Text("%s             ", star->name);
+    ImGui::Button("System Info");
+    ImGui::NextColumn();
+    ImGui::Text("Fleets:        ");
+    add_fleet_buttons_for_obs(*star, viewer);
+    ImGui::PopItemWidth();
+  }
+  ImGui::EndPopup();
+}
 
-  while(cur->id != from->id) {
-    ret.push_back(cur);
-    std::weak_ptr<Star> cur_ = data[cur->index].parent;
-    cur = cur_.lock();
-    if(not cur) { return {}; }
+// hover and clicks on whatever is under the mouse, unless it's over a window
+static void handle_map_mouse(MapView& map, const Stars& stars, const Observer& viewer, float vx, float vy) {
+  ImGuiIO& io = ImGui::GetIO();
+  ImVec2 mouse = io.MousePos;
+  bool clicked = io.WantCaptureMouse == false and ImGui::IsMouseClicked(0);
+
+  if(std::shared_ptr<Star> star = map.carried.lock()) {
+    if(clicked == true) {
+      star->moving = false;
+      map.carried.reset();
+      star_moved(*star, mouse.x + vx, mouse.y + vy);
+      printf("%s moved to %f, %f\n", star->name, star->x, star->y);
+    }
+  }
+  else if(io.WantCaptureMouse == false) {
+    if(const HitGrid::Item *hit = map.hits.at(mouse.x, mouse.y)) {
+      ImGui::GetWindowDrawList()->AddRect(ImVec2(hit->x0 + LABEL_INSET, hit->y0 + LABEL_INSET),
+					  ImVec2(hit->x1 - LABEL_INSET, hit->y1 - LABEL_INSET),
+					  ImGui::ColorConvertFloat4ToU32(ImVec4(1.0, 1.0, 1.0, 0.6)));
+      if(hit->kind == HitGrid::Kind::Fleet) {
+	fleet_tooltip(map.fleets[hit->index]);
+      }
+      else {
+	const std::shared_ptr<Star>& star = stars.stars[hit->index];
+	star_tooltip(*star, viewer);
+	if(clicked == true) {
+	  if(not g_selected_fleet.lock()) {
+	    map.menu_star = star;
+	    ImGui::OpenPopup("star menu");
+	  }
+	  else {
+	    g_selected_star1 = star;
+	  }
+	}
+      }
+    }
   }
 
-  ret.push_back(from);
-  reverse(ret.begin(), ret.end());
+  star_menu(map, viewer);
+}
 
-  return ret;
+// everything on the map, in one window of its own that takes no input
+static void draw_map(MapView& map, const Stars& stars, const Observations& obs, float vx, float vy,
+		     float sx, float sy, bool show_event_circles) {
+  map.hits.reset(sx, sy);
+  ImGui::SetNextWindowPos(ImVec2(0, 0));
+  ImGui::SetNextWindowSize(ImVec2(sx, sy));
+  ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(0, 0, 0, 0));
+  ImGui::Begin("map", NULL,
+	       ImGuiWindowFlags_NoTitleBar |
+	       ImGuiWindowFlags_NoResize |
+	       ImGuiWindowFlags_NoMove |
+	       ImGuiWindowFlags_NoScrollbar |
+	       ImGuiWindowFlags_NoInputs |
+	       ImGuiWindowFlags_NoSavedSettings |
+	       ImGuiWindowFlags_NoFocusOnAppearing |
+	       ImGuiWindowFlags_NoBringToFrontOnFocus);
+  ImGui::PopStyleColor();
+
+  const Observer& viewer = *obs.human_controller;
+  ViewRect view { vx, vy, vx + sx, vy + sy };
+  draw_stars(map, view, stars, viewer);
+  draw_observations(map, view, obs, show_event_circles);
+  handle_map_mouse(map, stars, viewer, vx, vy);
+  ImGui::End();
 }
 
 void switch_to_menu();
 
-struct Game {
+struct Game : public Simulation {
   ALLEGRO_KEYBOARD_STATE keyboard;
   ALLEGRO_BITMAP *bg;
 
-  int t;
   const float scroll_speed = 3;
   bool fleet_window;
   bool settings_window;
   bool log_window;
   int step;
   bool show_event_circles = true;
+  Autosave autosave { AUTOSAVE_FILE };
 
   float vx, vy;
 
   Engine *e;
-  MessageLog log;
-
-  Stars stars;
-  Observations obs;
-  Fleets fleets;
 
-  Game() { }
+  Game() { autosave.every = 100; }
   void init(Engine& _e, float _vx, float _vy) {
     vx = _vx;
     vy = _vy;
@@ -991,30 +911,7 @@ struct Game {
     bg = al_load_bitmap("./bg.png");
     assert(bg);
 
-    stars.init();
-
-    obs.add(Observer("Dv", stars.from_name("Epsilon Eridani"), al_map_rgb(143, 188, 143)));
-    obs.add(Observer("Xenos", stars.from_name("Ross 154"), al_map_rgb(72, 61, 139)));
-    // obs.add(Observer("Dv", stars.from_name("Epsilon Eridani"), al_map_rgb(255, 0, 0)));
-    // obs.add(Observer("Xenos", stars.from_name("Ross 154"), al_map_rgb(0, 0, 255)));
-    obs.human_controller = obs.observers.front();
-    std::shared_ptr<Observer> xeno = obs.observers[1];
-
-    stars.from_name("Epsilon Eridani")->set_full_owner(obs.human_controller);
-    stars.from_name("Procyon")->set_full_owner(obs.human_controller);
-
-    stars.from_name("Ross 154")->set_full_owner(xeno);
-    stars.from_name("Alpha Centauri")->set_full_owner(xeno);
-
-    obs.human_controller->add_stars(stars.stars);
-    xeno->add_stars(stars.stars);
-
-    fleets.add(Fleet("Epsilon Eridani Fleet", stars.from_name("Epsilon Eridani"), obs.human_controller));
-    fleets.add(Fleet("Lalande Fleet", stars.from_name("Lalande"), obs.human_controller));
-    fleets.add(Fleet("Ross 154 Fleet", stars.from_name("Ross 154"), xeno));
-    fleets.add(Fleet("Alpha Centauri Fleet", stars.from_name("Alpha Centauri"), xeno));
-
-    log.addMessage("Welcome to 2.7 Kelvin!", false);
+    Simulation::init();
   }
 
   void stuff() {
@@ -1023,7 +920,7 @@ struct Game {
       if(auto s = g_selected_star1.lock()) {
 
     	if(s != f->source) {
-    	  obs.addOrderFleetMove(f, f->source, s, obs.human_controller);
+    	  order(f, f->source, s, obs.human_controller);
     	}
 
     	g_selected_star1.reset();
@@ -1036,7 +933,7 @@ struct Game {
 
     if(s1 and s2) {
       printf("connecting %s - %s\n", s1->name, s1->name);
-      stars.graph.add(s1, s2);
+      connect(s1, s2);
 
       g_selected_star1.reset();
       g_selected_star2.reset();
@@ -1057,52 +954,23 @@ struct Game {
       case ALLEGRO_KEY_P:{ step = -1; }; break;
       case ALLEGRO_KEY_SPACE:{ step = -1; }; break;
       case ALLEGRO_KEY_FULLSTOP: { step = 1; e->paused = true; }; break;
+      case ALLEGRO_KEY_N: { fast_forward(next_event()); e->paused = true; }; break;
       case ALLEGRO_KEY_B: {
 	if(obs.human_controller == obs.observers[0]) {
-	  obs.human_controller = obs.observers[1];
+	  set_controller(obs.observers[1]);
 	}
 	else {
-	  obs.human_controller = obs.observers[0];
+	  set_controller(obs.observers[0]);
 	}
       }; break;
       default: { }; break;
       }
   }
 
-  void tick() {
-    t++;
-    log.year = t;
-    obs.tick_events_created = 0;
-    fleets.update(obs, *this);
-    obs.update(stars.graph, fleets, log);
-    stars.update();
-  }
-
-  void fleetArrived(std::shared_ptr<Fleet>& arrived)
-  {
-    std::vector<std::shared_ptr<Fleet>>::iterator it = fleets.fleets.begin();
-    while(it != fleets.fleets.end()) {
-      bool encounter = (*it)->t == 0 and arrived->id != (*it)->id and (*it)->source->id == arrived->source->id;
-
-      if(encounter == true) {
-	// TODO hmm
-	bool is_enemy = (*it)->owner.lock()->id != arrived->owner.lock()->id;
-
-	if(is_enemy == true) {
-	  printf("%s died at %s\n", (*it)->name, (*it)->source->name);
-	  obs.addFleetCombat(*it);
-	  it = fleets.fleets.erase(it);
-	  continue;
-	}
-      }
-      it++;
-    }
-  }
-
   void draw() {
     if(e->draw_background) {
       if(bg) {
-	al_draw_scaled_bitmap(bg, 0, 0, 1280, 720, 0, 0, e->sx, e->sy, 0);
+	draw_background(g_map, bg, e->sx, e->sy);
       }
       // float i = 50;
       // al_draw_filled_rectangle(0, 0, e->sx, e->sy, al_map_rgba((i / 255) * 100, (i / 255) * 255, (i / 255) * 255, 30));
@@ -1110,7 +978,7 @@ struct Game {
     else {
       e->clear();
     }
-    stars.draw(vx, vy, *obs.human_controller);
+    draw_map(g_map, stars, obs, vx, vy, e->sx, e->sy, show_event_circles);
 
     extern ImFont *bigger;
     ImGui::PushFont(bigger);
@@ -1244,166 +1112,37 @@ struct Game {
       ImGui::Checkbox("Show event circles", &show_event_circles);
       ImGui::Checkbox("Draw background", &e->draw_background);
       ImGui::Checkbox("Draw fleet traces", &g_draw_fleet_traces);
+      ImGui::SliderInt("Trace spacing", &g_fleet_trace_spacing, 1, 10);
       ImGui::Checkbox("Draw influence circles", &g_draw_influence_circles);
       ImGui::Checkbox("Allow star movement", &g_star_moving);
+      ImGui::InputInt("Autosave every", &autosave.every);
+      ImGui::Separator();
+      static int year = 3300;
+      ImGui::InputInt("Year", &year);
+      if(ImGui::Button("Fast forward")) {
+	fast_forward(year);
+      }
       ImGui::Separator();
       static char buf[32] = "Star name";
       ImGui::InputText("Star name", buf, 32);
       if(ImGui::Button("Create")) {
-	stars.add(buf);
+	add_star(buf, 0, 0);
       }
       ImGui::End();
     }
-
-    // for(auto&& fleet : fleets.fleets) {
-    //   fleet->draw(vx, vy);
-    // }
-    obs.draw(vx, vy, show_event_circles);
   }
 };
 
 void add_fleet_buttons_for_obs(const Star& s, const Observer& o) {
-  for(auto&& fleet : o.known_idle_fleets) {
-    if(fleet->source->id == s.id) {
-      if(ImGui::Button(fleet->name)) {
-      	g_selected_fleet = fleet;
-      	g_selected_star1.reset();
-      }
-    }
-  }
-}
-
-float distance_to_star(const Observer& o, const Star& s) {
-  return
-    sqrt((s.x - o.home->x) * (s.x - o.home->x) +
-	 (s.y - o.home->y) * (s.y - o.home->y)) / PX_PER_LIGHTYEAR;
-}
-
-void Fleets::update(Observations& obs, Game& g) {
-  std::vector<std::weak_ptr<Fleet>> arrived_fleets;
-
-  // move fleets
-  for(auto&& fleet : fleets) {
-    fleet->update();
-
-    if(fleet->moving == false and fleet->t != 0) {
-      obs.addFleetArrival(fleet);
-      fleet->t = 0;
-      arrived_fleets.emplace_back(std::move(fleet));
-    }
-  }
-
-  // process combat
-  for(auto&& fleet : arrived_fleets) {
-    if(auto f = fleet.lock()) {
-      g.fleetArrived(f);
-    }
-  }
-
-  // move surviving ships on paths
-  for(auto&& fleet : fleets) {
-    if(fleet->moving == false) {
-      if(not fleet->path.empty()) {
-	if(fleet->path.size() == 1) { // it is what it is
-	  fleet->path.clear();
-	  fleet->source = fleet->destination;
-	  fleet->t = 0;
-	  continue;
-	}
-
-	if(auto next = fleet->path.front().lock()) {
-	  fleet->move_to(g.stars.graph, next);
-	  obs.addFleetDeparture(fleet);
-	}
-      }
-    }
-  }
-
-  for(auto&& event : obs.events) {
-    event.fleet1->update();
-  }
-
-  for(auto&& fleet : obs.human_controller->known_travelling_fleets) {
-    fleet->update();
-  }
-}
-
-void Fleet::move_to(const StarGraph& g, std::shared_ptr<Star>& d) {
-  // check if d is a neighbor of the fleet's star
-  bool direct = false;
-  for(auto&& neighbor : source->neighbors) {
-    if(auto n = neighbor.lock()) {
-      if(n->id == d->id) { direct = true; }
-    }
-  }
-
-  if(direct == false) {
-    if(path.empty()) {
-      path = g.pathfind(source, d);
-    }
-    printf("*** path:");
-    for(auto&& p : path) printf(" %s", p.lock()->name);
-    puts("\n");
-
-    if(path.empty()) {
-      printf("Fail whale: Couldn't find path from %s to %s\n", source->name, d->name);
-      return;
-    }
-
-    path.erase(path.begin());
-    if(auto dest = path.front().lock()) {
-      source = destination;
-      destination = dest;
-      printf("%s -> %s\n\n", source->name, destination->name);
-    }
-    else {
-      exit(1);
-    }
-  }
-  else {
-    destination = d;
-  }
-
-  distance =
-    sqrt((source->x - destination->x) * (source->x - destination->x) +
-	 (source->y - destination->y) * (source->y - destination->y));
-
-  moving = true;
-  t = 0;
-}
-
-void Fleet::update() {
-  if(moving == false) {
-    // docked in star system
-    return;
-  }
-
-  // travelling
-  t += (velocity * PX_PER_LIGHTYEAR) / distance;
-
-  if(t >= 1) {
-    // we've arrived
-    source = destination;
-    x = source->x;
-    y = source->y;
-    trace.clear();
-    moving = false;
-
-  }
-  else {
-    x = lerp(source->x, destination->x, t);
-    y = lerp(source->y, destination->y, t);
-
-    if(g_draw_fleet_traces == true) {
-      for(auto&& t : trace) {
-	t.r += 1;
-      }
-
-      trace.emplace_back(FleetTrace(x, y, 0));
+  const DockIndex& idle = o.idle_by_star();
+  for(int i = idle.first(s.index); i != DockIndex::none; i = idle.next[i]) {
+    auto& fleet = o.known_idle_fleets[i];
+    if(ImGui::Button(fleet->name)) {
+      g_selected_fleet = fleet;
+      g_selected_star1.reset();
     }
   }
 }
-
 static void show_debug_window(Engine& e, Game& g) {
   if(e.debug_win == true) {
     ImGui::Begin("Debug", &e.debug_win);
@@ -1431,6 +1170,17 @@ static void show_debug_window(Engine& e, Game& g) {
 
     ImGui::Text("Travelling Events: %ld", g.obs.events.size());
     ImGui::Text("Created Events: %d", g.obs.tick_events_created);
+    ImGui::Separator();
+
+    Autosave::Report save = g.autosave.report();
+    if(save.year == 0) {
+      ImGui::Text("Autosave: none yet");
+    }
+    else {
+      ImGui::Text("Autosave: year %d, %s", save.year, not save.done ? "writing" : save.ok ? "ok" : "failed");
+      ImGui::Text("Snapshot: %.2f ms", save.snapshot_ms);
+      ImGui::Text("Write: %.1f ms", save.write_ms);
+    }
     ImGui::End();
   }
 }
@@ -1441,6 +1191,8 @@ struct UI {
 };
 
 void switch_to_game();
+bool load_game();
+void save_game();
 
 struct TitleUI : public UI {
   Engine *engine;
@@ -1482,8 +1234,12 @@ struct TitleUI : public UI {
     if(ImGui::Button("New", sz)) {
       switch_to_game();
     }
-    ImGui::Button("Load", sz);
-    ImGui::Button("Save", sz);
+    if(ImGui::Button("Load", sz) and load_game()) {
+      switch_to_game();
+    }
+    if(ImGui::Button("Save", sz)) {
+      save_game();
+    }
     ImGui::Button("Options", sz);
     ImGui::Button("Help", sz);
     if(ImGui::Button("Exit", sz)) {
@@ -1544,6 +1300,8 @@ struct GameUI : public UI {
       }
       g.step--;
     }
+
+    g.autosave.update(g);
   }
 };
 
@@ -1556,23 +1314,75 @@ std::shared_ptr<Star> star_from_name(const char *name) {
   return g.stars.from_name(name);
 }
 
+void star_moved(Star& star, float x, float y) {
+  g.move_star(star, x, y);
+}
+
 void switch_to_game() {
   ui = gameUI;
 }
 
+bool load_game() {
+  if(not g.load(SAVE_FILE)) {
+    fprintf(stderr, "%s: can't load save\n", SAVE_FILE);
+    return false;
+  }
+  g_selected_star1.reset();
+  g_selected_star2.reset();
+  g_selected_fleet.reset();
+  g_map.reset();
+  g.autosave.started = INT_MIN;
+  // the journal starts from a new game, it can't replay a loaded one
+  if(g.journal) {
+    g.journal->close();
+    g.journal = nullptr;
+  }
+  return true;
+}
+
+void save_game() {
+  if(not g.save(SAVE_FILE)) {
+    perror(SAVE_FILE);
+  }
+}
+
 void switch_to_menu() {
   ui = titleUI;
   g.e->paused = true;
 }
 
-int main()
+int main(int argc, char **argv)
 {
+  const char *journal_path = NULL;
+  int opt;
+  while((opt = getopt(argc, argv, "J:")) != -1) {
+    switch(opt)
+      {
+      case 'J': { journal_path = optarg; }; break;
+      default: {
+	fprintf(stderr, "usage: %s [-J journal]\n"
+		"  -J journal      record everything the player does, for replaying with 27kelvin-sim -R\n", argv[0]);
+	return 1;
+      }; break;
+      }
+  }
+
   Engine e("2.7 Kelvin", 1280, 720);
   e.init();
 
   g.init(e, -220, -100);
   g.init();
 
+  Journal journal;
+  if(journal_path) {
+    if(journal.create(journal_path, g.header())) {
+      g.journal = &journal;
+    }
+    else {
+      perror(journal_path);
+    }
+  }
+
   gameUI = new GameUI(&g);
   titleUI = new TitleUI(&e);
   ui = titleUI;
@@ -1582,5 +1392,8 @@ int main()
     e.begin_frame();
     ui->update();
   }
+  if(g.journal) {
+    journal.write(Journal::Record(g.t, Journal::Type::End));
+  }
   e.stop();
 }
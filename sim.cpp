@@ -0,0 +1,2362 @@
+#include "./sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <chrono>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+bool g_draw_fleet_traces = true;
+int g_fleet_trace_spacing = 1;
+bool g_sim_log = true;
+int g_sim_threads = -1;
+
+void MessageLog::addEventMessage(const ObservableEvent& event, const FleetState& fleet, const Stars& stars) {
+  static char buf[128];
+  switch(event.type)
+    {
+    case ObservableEventType::FleetDeparture:
+      {
+	sprintf(buf, "%s departed from %s to %s", fleet.name, stars.stars[event.orderTarget]->name, stars.stars[event.orderMoveTo]->name);
+      };
+      break;
+    case ObservableEventType::FleetArrival:
+      {
+	sprintf(buf, "%s arrived at %s", fleet.name, stars.stars[event.orderMoveTo]->name);
+      };
+      break;
+    case ObservableEventType::CombatReport:
+      {
+	sprintf(buf, "%s was destroyed at %s", fleet.name, fleet.source->name);
+      };
+      break;
+    default:
+      {
+	return;
+      };
+      break;
+    }
+  sim_log("Log message: %s\n", buf);
+  addMessage(buf);
+}
+
+const char *get_fleet_name(const Fleet& f) {
+  return f.name;
+}
+
+const char *get_observer_name(const Observer& o) {
+  return o.name;
+}
+
+float distance_to_star(const Observer& o, const Star& s) {
+  return
+    sqrt((s.x - o.home->x) * (s.x - o.home->x) +
+	 (s.y - o.home->y) * (s.y - o.home->y)) / PX_PER_LIGHTYEAR;
+}
+
+// Number of ticks until a wavefront born at (x, y) covers (tx, ty). The
+// comparison is done in float exactly like the old per-tick check so that
+// events arrive on the same tick they always did.
+static int ticks_to_reach(float x, float y, float tx, float ty) {
+  float distance_squared = (x - tx) * (x - tx) + (y - ty) * (y - ty);
+  int k = std::max(1, (int)ceil(sqrt(distance_squared) / PX_PER_LIGHTYEAR));
+
+  for(;;) {
+    float t = k;
+    if(t * t * PX_PER_LIGHTYEAR * PX_PER_LIGHTYEAR < distance_squared) { k++; continue; }
+    t = k - 1;
+    if(k > 1 and t * t * PX_PER_LIGHTYEAR * PX_PER_LIGHTYEAR >= distance_squared) { k--; continue; }
+    return k;
+  }
+}
+
+// Work out once when the event reaches each observer (or, for orders, the
+// target star) instead of testing every event against every observer on
+// every tick.
+void Observations::schedule(ObservableEvent& event) {
+  event.seq = max_event_seq;
+  max_event_seq++;
+
+  bool order = event.type == ObservableEventType::OrderFleetMove;
+  event.pending = order ? 1 : observers.size();
+  EventHandle h = events.add(event);
+
+  if(order == true) {
+    const Star& target = *stars->stars[event.orderTarget];
+    int k = ticks_to_reach(event.x, event.y, target.x, target.y);
+    order_deliveries.push(Delivery { event.birth + k, event.seq, -1, h });
+    return;
+  }
+
+  for(size_t i = 0; i < observers.size(); i++) {
+    const Star& home = *observers[i]->home;
+    int k = ticks_to_reach(event.x, event.y, home.x, home.y);
+    observers[i]->deliveries.push(Delivery { event.birth + k, event.seq, (int)i, h });
+  }
+}
+
+// Stars can be dragged around in the editor, which invalidates every
+// arrival tick. Wavefronts that have already passed a star that moved are
+// delivered on the next tick.
+void Observations::reschedule() {
+  order_deliveries = DeliveryQueue();
+  for(auto&& observer : observers) {
+    observer->deliveries = DeliveryQueue();
+  }
+
+  for(auto&& h : events.live) {
+    ObservableEvent event = events.get(h);
+    events.pending[h] = 0;
+
+    if(event.type == ObservableEventType::OrderFleetMove) {
+      const Star& target = *stars->stars[event.orderTarget];
+      int k = ticks_to_reach(event.x, event.y, target.x, target.y);
+      order_deliveries.push(Delivery { std::max(event.birth + k, now + 1), event.seq, -1, h });
+      events.pending[h]++;
+      continue;
+    }
+
+    for(size_t i = 0; i < observers.size(); i++) {
+      if(observers[i]->has_seen(event)) {
+	continue;
+      }
+      const Star& home = *observers[i]->home;
+      int k = ticks_to_reach(event.x, event.y, home.x, home.y);
+      observers[i]->deliveries.push(Delivery { std::max(event.birth + k, now + 1), event.seq, (int)i, h });
+      events.pending[h]++;
+    }
+  }
+}
+
+void Observations::retire(EventHandle h) {
+  for(auto&& observer : observers) { observer->remove_event(events.id[h]); }
+  snapshots.remove(events.fleet[h]);
+  events.remove(h);
+}
+
+void Observations::processEvent(Observer& observer, const ObservableEvent& event, MessageLog& log) {
+  if(observer.has_seen(event)) {
+    return;
+  }
+
+  const std::shared_ptr<const FleetState>& state = snapshots.ref(event.fleet1);
+  const FleetState& fleet = *state;
+
+  switch(event.type)
+    {
+    case ObservableEventType::FleetArrival:
+      {
+	if(not FleetEventInVector(observer.known_idle_fleets, event)) {
+	  // we haven't seen this even before
+	  observer.known_idle_fleets.emplace_back(state);
+	  observer.idle_dirty = true;
+	  if(observer.id == fleet.owner.lock()->id) {
+	    update_star_knowledge(observer, fleet.destination);
+	  }
+	  sim_log("Observer %s saw fleet \"%s\" arrive\n", observer.name, fleet.name);
+	  if(observer.id == human_controller->id) {
+	    log.addEventMessage(event, fleet, *stars);
+	  }
+	  RemoveFleetEventInVector(observer.known_travelling_fleets, event);
+	}
+      };
+      break;
+
+    case ObservableEventType::FleetDeparture:
+      {
+	if(not FleetEventInVector(observer.known_travelling_fleets, event)) {
+	  // we haven't seen this even before
+	  observer.known_travelling_fleets.emplace_back(state);
+	  sim_log("Observer %s saw fleet \"%s\" depart\n", observer.name, fleet.name);
+	  if(observer.id == fleet.owner.lock()->id) {
+	    update_star_knowledge(observer, stars->stars[event.orderTarget]);
+	  }
+	  if(observer.id == human_controller->id) {
+	    log.addEventMessage(event, fleet, *stars);
+	  }
+	  RemoveFleetEventInVector(observer.known_idle_fleets, event);
+	  observer.idle_dirty = true;
+	}
+      };
+      break;
+
+    case ObservableEventType::CombatReport:
+      if(FleetEventInVector(observer.known_idle_fleets, event)) {
+	// can the arrival event come after the combat report?
+	sim_log("Observer %s saw fleet \"%s\" destroyed at %s\n", observer.name, fleet.name, fleet.source->name);
+	if(observer.id == fleet.owner.lock()->id) {
+	  update_star_knowledge(observer, fleet.source);
+	}
+	if(observer.id == human_controller->id) {
+	  log.addEventMessage(event, fleet, *stars);
+	}
+	RemoveFleetEventInVector(observer.known_idle_fleets, event);
+	observer.idle_dirty = true;
+      }
+      break;
+
+    default:
+      {
+      };
+      break;
+    }
+
+  observer.add_event(event);
+}
+
+void Observations::update(const StarGraph& graph, Fleets& fleets, MessageLog& log) {
+  now++;
+
+  // collect every wavefront arriving this tick
+  due.clear();
+  while(not order_deliveries.empty() and order_deliveries.top().tick <= now) {
+    due.push_back(order_deliveries.top());
+    order_deliveries.pop();
+  }
+  for(auto&& observer : observers) {
+    while(not observer->deliveries.empty() and observer->deliveries.top().tick <= now) {
+      due.push_back(observer->deliveries.top());
+      observer->deliveries.pop();
+    }
+  }
+  std::sort(due.begin(), due.end(), [](const Delivery& a, const Delivery& b) { return b > a; });
+
+  // Observers take their deliveries independently, on the workers. All
+  // processEvent touches is the observer, and the log for the human
+  // controller only, so each observer's events in due order give the same
+  // result as the loop below. Orders and retiring events touch shared
+  // state and stay in that loop. Serial when logging, to keep it readable,
+  // and for ticks with too little to share out.
+  size_t threads = g_sim_threads >= 0 ? g_sim_threads : std::max(1u, std::thread::hardware_concurrency()) - 1;
+  bool sharded = threads > 0 and observers.size() > 1 and g_sim_log == false and due.size() >= shard_min_due;
+
+  if(sharded == true) {
+    if(workers.size() != threads) {
+      workers.resize(threads);
+    }
+    due_start.assign(observers.size() + 1, 0);
+    for(auto&& d : due) {
+      if(d.observer != -1) { due_start[d.observer + 1]++; }
+    }
+    for(size_t i = 0; i < observers.size(); i++) { due_start[i + 1] += due_start[i]; }
+    due_by_observer.resize(due_start.back());
+    due_fill.assign(due_start.begin(), due_start.end() - 1);
+    for(size_t i = 0; i < due.size(); i++) {
+      if(due[i].observer != -1) { due_by_observer[due_fill[due[i].observer]++] = i; }
+    }
+
+    shard_log = &log;
+    workers.run(observers.size(), shard);
+  }
+
+  bool retired = false;
+
+  for(auto&& d : due) {
+    EventHandle h = d.event;
+
+    if(d.observer == -1) {
+      // orders are erased when they reach the target star
+      processOrder(graph, fleets, events.get(h), *human_controller);
+    }
+    else if(sharded == false) {
+      // other events propagate until they reach all observers
+      processEvent(*observers[d.observer], events.get(h), log);
+    }
+
+    events.pending[h]--;
+    if(events.pending[h] == 0) {
+      retire(h);
+      retired = true;
+    }
+  }
+
+  for(auto&& order : order_add_queue) {
+    order.birth = now;
+    schedule(order);
+  }
+  order_add_queue.clear();
+
+  if(retired == true) {
+    int oldest = events.oldest_id(max_event_id);
+    for(auto&& observer : observers) { observer->seen_events.retire_below(oldest); }
+  }
+}
+
+void WorkerPool::resize(size_t n) {
+  if(not threads.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      stop = true;
+    }
+    wake.notify_all();
+    for(auto&& t : threads) { t.join(); }
+    threads.clear();
+    stop = false;
+  }
+
+  for(size_t i = 0; i < n; i++) {
+    threads.emplace_back([this]() {
+	std::unique_lock<std::mutex> lock(m);
+	int seen = generation;
+	while(true) {
+	  wake.wait(lock, [&]() { return stop or generation != seen; });
+	  if(stop == true) {
+	    return;
+	  }
+	  seen = generation;
+	  work(lock);
+	}
+      });
+  }
+}
+
+// hands out shards until there are none left, m is held on entry and exit
+void WorkerPool::work(std::unique_lock<std::mutex>& lock) {
+  while(next < shards) {
+    int shard = next++;
+    lock.unlock();
+    (*job)(shard);
+    lock.lock();
+    finished++;
+  }
+  if(finished == shards) {
+    done.notify_all();
+  }
+}
+
+void WorkerPool::run(int n, const std::function<void(int)>& f) {
+  if(threads.empty()) {
+    for(int i = 0; i < n; i++) { f(i); }
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(m);
+  job = &f;
+  shards = n;
+  next = 0;
+  finished = 0;
+  generation++;
+  wake.notify_all();
+  work(lock);
+  done.wait(lock, [&]() { return finished == shards; });
+}
+
+const uint32_t Journal::version;
+
+static void put(FILE *f, const void *p, size_t n) { fwrite(p, n, 1, f); }
+static bool get(FILE *f, void *p, size_t n) { return fread(p, n, 1, f) == 1; }
+
+bool Journal::create(const char *path, const Header& h) {
+  close();
+  f = fopen(path, "wb");
+  if(not f) {
+    return false;
+  }
+  int32_t v[] = { h.start, h.generated, h.scenario.stars, h.scenario.fleets,
+		  h.scenario.observers, (int32_t)h.scenario.seed };
+  put(f, "27KJ", 4);
+  put(f, &version, sizeof(version));
+  put(f, v, sizeof(v));
+  fflush(f);
+  return true;
+}
+
+bool Journal::open(const char *path, Header& h) {
+  close();
+  f = fopen(path, "rb");
+  if(not f) {
+    return false;
+  }
+  char magic[4];
+  uint32_t v;
+  int32_t fields[6];
+  if(not get(f, magic, 4) or memcmp(magic, "27KJ", 4) != 0 or
+     not get(f, &v, sizeof(v)) or v != version or not get(f, fields, sizeof(fields))) {
+    close();
+    return false;
+  }
+  h.start = fields[0];
+  h.generated = fields[1];
+  h.scenario.stars = fields[2];
+  h.scenario.fleets = fields[3];
+  h.scenario.observers = fields[4];
+  h.scenario.seed = fields[5];
+  return true;
+}
+
+// flushed every time, it's there for when the game goes down
+void Journal::write(const Record& r) {
+  int32_t tick = r.tick;
+  put(f, &tick, sizeof(tick));
+  put(f, &r.type, sizeof(r.type));
+  switch(r.type)
+    {
+    case Type::Order: { int32_t v[] = { r.a, r.b, r.c, r.d }; put(f, v, sizeof(v)); }; break;
+    case Type::MoveStar: { int32_t a = r.a; put(f, &a, 4); put(f, &r.x, 4); put(f, &r.y, 4); }; break;
+    case Type::AddStar: {
+      uint8_t len = std::min(r.name.size(), (size_t)255);
+      put(f, &r.x, 4); put(f, &r.y, 4); put(f, &len, 1); put(f, r.name.data(), len);
+    }; break;
+    case Type::Connect: { int32_t v[] = { r.a, r.b }; put(f, v, sizeof(v)); }; break;
+    case Type::Controller: { int32_t a = r.a; put(f, &a, 4); }; break;
+    case Type::End: { }; break;
+    }
+  fflush(f);
+}
+
+bool Journal::read(Record& r) {
+  int32_t tick;
+  if(not get(f, &tick, sizeof(tick)) or not get(f, &r.type, sizeof(r.type))) {
+    return false;
+  }
+  r.tick = tick;
+  switch(r.type)
+    {
+    case Type::Order: {
+      int32_t v[4];
+      if(not get(f, v, sizeof(v))) { return false; }
+      r.a = v[0]; r.b = v[1]; r.c = v[2]; r.d = v[3];
+    }; break;
+    case Type::MoveStar: {
+      int32_t a;
+      if(not get(f, &a, 4) or not get(f, &r.x, 4) or not get(f, &r.y, 4)) { return false; }
+      r.a = a;
+    }; break;
+    case Type::AddStar: {
+      uint8_t len;
+      char buf[256];
+      if(not get(f, &r.x, 4) or not get(f, &r.y, 4) or not get(f, &len, 1) or
+	 (len > 0 and not get(f, buf, len))) {
+	return false;
+      }
+      r.name.assign(buf, len);
+    }; break;
+    case Type::Connect: {
+      int32_t v[2];
+      if(not get(f, v, sizeof(v))) { return false; }
+      r.a = v[0]; r.b = v[1];
+    }; break;
+    case Type::Controller: {
+      int32_t a;
+      if(not get(f, &a, 4)) { return false; }
+      r.a = a;
+    }; break;
+    case Type::End: { }; break;
+    default: { return false; }; break;
+    }
+  return true;
+}
+
+void Journal::close() {
+  if(f) {
+    fclose(f);
+    f = nullptr;
+  }
+}
+
+// Save files are a header, a table of sections and then the sections,
+// each an array of plain records or numbers starting on an 8 byte
+// boundary. A load maps the file and copies the big arrays (lanes, star
+// positions, the event pool) into place whole, only stars, fleets and the
+// fleet states shared between events and observers are built one by one.
+// Stars, fleets and observers are referred to by index or id, published
+// fleet states by their row in States. Native byte order.
+static const uint32_t save_version = 1;
+
+enum class SaveSection : uint32_t {
+  Meta = 1, Names, Messages,
+  Stars, StarBase, LaneStart, LaneTo, LaneLength, StarX, StarY,
+  Fleets, FleetRoutes, DockedAt, Placed, States, Snapshots, SnapshotFree,
+  EventId, EventType, EventX, EventY, EventBirth, EventSeq, EventPending,
+  EventSender, EventTarget, EventMoveTo, EventFleet,
+  EventLive, EventLiveIndex, EventFree, EventIds, RetiredWords,
+  OrderQueue, OrderDeliveries,
+  Observers, KnownFleets, KnownStars, SeenWords, Deliveries,
+};
+
+struct SaveHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t sections;
+  uint32_t unused;
+};
+
+struct SaveEntry {
+  uint32_t section;
+  uint32_t size; // of one element, to catch records that changed
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct SavedMeta {
+  int32_t t, generated;
+  int32_t scenario_stars, scenario_fleets, scenario_observers;
+  uint32_t scenario_seed;
+  int32_t star_max_id, fleet_max_id;
+  int32_t max_observer_id, max_event_id, max_event_seq, tick_events_created;
+  int32_t now, fleet_ticks;
+  int32_t human_controller; // observer id, -1 if none
+  int32_t log_year;
+  int32_t retired_base;
+};
+
+struct SavedStar {
+  int32_t id;
+  uint32_t name;
+  float x, y;
+  int32_t owner; // observer id, -1 if none
+  int32_t version;
+};
+
+struct SavedStarState {
+  int32_t index, version, owner;
+};
+
+struct SavedState {
+  int32_t id, version, published, departed;
+  float x, y, t, velocity, distance;
+  int32_t moving;
+  int32_t source, destination; // star indexes, -1 if none
+  int32_t owner; // observer id, -1 if none
+  uint32_t name; // NameTable::none if none
+};
+
+struct SavedFleet {
+  SavedState state;
+  int32_t last_published; // into States, -1 if none
+  uint32_t path, waypoints; // hops in FleetRoutes, the path then the waypoints
+};
+
+// how many of each the observer has are in the shared sections, in order
+struct SavedObserver {
+  int32_t id;
+  uint32_t name;
+  int32_t home; // star index
+  uint8_t r, g, b, unused;
+  int32_t seen_base;
+  uint32_t travelling, idle, known_stars, seen_words, deliveries;
+};
+
+struct SaveWriter {
+  struct Part {
+    const void *data;
+    SaveEntry entry;
+  };
+  std::vector<Part> parts;
+
+  template<typename T>
+  void add(SaveSection s, const T *data, size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value, "sections are plain data");
+    parts.push_back(Part { data, SaveEntry { (uint32_t)s, sizeof(T), 0, count } });
+  }
+
+  template<typename T>
+  void add(SaveSection s, const std::vector<T>& v) {
+    add(s, v.data(), v.size());
+  }
+
+  void image(std::vector<char>& out);
+};
+
+// the whole file, header, entries and sections each at a multiple of 8
+void SaveWriter::image(std::vector<char>& out) {
+  uint64_t end = sizeof(SaveHeader) + parts.size() * sizeof(SaveEntry);
+  for(auto&& p : parts) {
+    p.entry.offset = (end + 7) & ~(uint64_t)7;
+    end = p.entry.offset + p.entry.size * p.entry.count;
+  }
+
+  out.resize(end); // kept from the last one, only the padding is zeroed
+  SaveHeader h = { { '2', '7', 'K', 'S' }, save_version, (uint32_t)parts.size(), 0 };
+  memcpy(out.data(), &h, sizeof(h));
+  char *entries = out.data() + sizeof(h);
+  uint64_t at = sizeof(SaveHeader) + parts.size() * sizeof(SaveEntry);
+  for(auto&& p : parts) {
+    memcpy(entries, &p.entry, sizeof(p.entry));
+    entries += sizeof(p.entry);
+    memset(out.data() + at, 0, p.entry.offset - at);
+    at = p.entry.offset + p.entry.size * p.entry.count;
+    if(p.entry.count > 0) {
+      memcpy(out.data() + p.entry.offset, p.data, p.entry.size * p.entry.count);
+    }
+  }
+}
+
+// To `tmp` first and synced, then renamed over `path`, so a failed save
+// or a crash leaves the last one alone. Nothing but system calls on
+// memory the caller owns, so it's also safe in a child forked from a
+// process with threads.
+static bool write_save(const char *path, const char *tmp, const char *data, size_t size) {
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    return false;
+  }
+  bool ok = true;
+  while(size > 0) {
+    ssize_t n = write(fd, data, size);
+    if(n < 0 and errno == EINTR) {
+      continue;
+    }
+    if(n <= 0) {
+      ok = false;
+      break;
+    }
+    data += n;
+    size -= n;
+  }
+  ok = ok and fsync(fd) == 0;
+  ok = close(fd) == 0 and ok;
+  if(not ok or rename(tmp, path) != 0) {
+    unlink(tmp);
+    return false;
+  }
+  return true;
+}
+
+template<typename T>
+struct SaveSpan {
+  const T *p = nullptr;
+  size_t n = 0;
+
+  size_t size() const { return n; }
+  const T& operator[](size_t i) const { return p[i]; }
+  const T *begin() const { return p; }
+  const T *end() const { return p + n; }
+};
+
+// A save file mapped read only, its sections are used straight from the
+// mapping
+struct SaveMap {
+  const char *p = nullptr;
+  size_t size = 0;
+  const SaveEntry *entries = nullptr;
+  uint32_t sections = 0;
+
+  SaveMap() = default;
+  SaveMap(const SaveMap&) = delete;
+  ~SaveMap() {
+    if(p) {
+      munmap((void *)p, size);
+    }
+  }
+
+  bool open(const char *path);
+
+  // false if the section is missing or isn't an array of T
+  template<typename T>
+  bool get(SaveSection s, SaveSpan<T>& out) const {
+    for(uint32_t i = 0; i < sections; i++) {
+      const SaveEntry& e = entries[i];
+      if(e.section != (uint32_t)s) {
+	continue;
+      }
+      if(e.size != sizeof(T) or e.offset % 8 != 0 or e.offset > size or
+	 e.count > (size - e.offset) / sizeof(T)) {
+	return false;
+      }
+      out.p = (const T *)(p + e.offset);
+      out.n = e.count;
+      return true;
+    }
+    return false;
+  }
+
+  template<typename T>
+  bool read(SaveSection s, std::vector<T>& v) const {
+    SaveSpan<T> span;
+    if(not get(s, span)) {
+      return false;
+    }
+    v.assign(span.begin(), span.end());
+    return true;
+  }
+};
+
+bool SaveMap::open(const char *path) {
+  int fd = ::open(path, O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) == 0 and st.st_size >= (off_t)sizeof(SaveHeader)) {
+    void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(m != MAP_FAILED) {
+      p = (const char *)m;
+      size = st.st_size;
+    }
+  }
+  ::close(fd);
+  if(not p) {
+    return false;
+  }
+
+  const SaveHeader *h = (const SaveHeader *)p;
+  if(memcmp(h->magic, "27KS", 4) != 0 or h->version != save_version or
+     h->sections > (size - sizeof(SaveHeader)) / sizeof(SaveEntry)) {
+    return false;
+  }
+  sections = h->sections;
+  entries = (const SaveEntry *)(p + sizeof(SaveHeader));
+  return true;
+}
+
+// NUL terminated strings one after the other
+template<typename Strings>
+static std::vector<char> join_strings(const Strings& strings) {
+  std::vector<char> text;
+  for(auto&& s : strings) {
+    const char *c = &s[0];
+    text.insert(text.end(), c, c + strlen(c) + 1);
+  }
+  return text;
+}
+
+static std::vector<const char *> split_strings(const SaveSpan<char>& text) {
+  std::vector<const char *> strings;
+  size_t i = 0;
+  while(i < text.size()) {
+    const char *s = &text[i];
+    const char *end = (const char *)memchr(s, 0, text.size() - i);
+    if(not end) {
+      break;
+    }
+    strings.push_back(s);
+    i += end - s + 1;
+  }
+  return strings;
+}
+
+static int32_t observer_id(const std::weak_ptr<Observer>& o) {
+  std::shared_ptr<Observer> p = o.lock();
+  return p ? p->id : -1;
+}
+
+bool Simulation::save(const char *path) const {
+  std::vector<char> image;
+  serialize(image);
+  std::string tmp = std::string(path) + ".tmp";
+  return write_save(path, tmp.c_str(), image.data(), image.size());
+}
+
+void Simulation::serialize(std::vector<char>& image) const {
+  // the lanes go out as the search uses them
+  if(stars.graph.dirty == true) {
+    stars.graph.build();
+  }
+
+  SaveWriter out;
+  SavedMeta meta = {
+    t, generated, scenario.stars, scenario.fleets, scenario.observers, scenario.seed,
+    stars.max_id, fleets.max_id,
+    obs.max_observer_id, obs.max_event_id, obs.max_event_seq, obs.tick_events_created,
+    obs.now, obs.fleet_ticks,
+    obs.human_controller ? obs.human_controller->id : -1,
+    log.year,
+    obs.events.retired_ids.base,
+  };
+  out.add(SaveSection::Meta, &meta, 1);
+
+  std::vector<char> name_text = join_strings(names.strings);
+  std::vector<char> message_text = join_strings(log.messages);
+  out.add(SaveSection::Names, name_text);
+  out.add(SaveSection::Messages, message_text);
+
+  std::vector<SavedStar> saved_stars;
+  saved_stars.reserve(stars.stars.size());
+  for(auto&& s : stars.stars) {
+    saved_stars.push_back(SavedStar { s->id, s->name_id, s->x, s->y, observer_id(s->owner), s->version });
+  }
+  std::vector<SavedStarState> base;
+  base.reserve(stars.base.size());
+  for(size_t i = 0; i < stars.base.size(); i++) {
+    base.push_back(SavedStarState { (int32_t)i, stars.base[i].version, observer_id(stars.base[i].owner) });
+  }
+  const StarGraph& g = stars.graph;
+  out.add(SaveSection::Stars, saved_stars);
+  out.add(SaveSection::StarBase, base);
+  out.add(SaveSection::LaneStart, g.lane_start);
+  out.add(SaveSection::LaneTo, g.lane_to);
+  out.add(SaveSection::LaneLength, g.lane_length);
+  out.add(SaveSection::StarX, g.star_x);
+  out.add(SaveSection::StarY, g.star_y);
+
+  // every published state once, however many events and observers share it
+  std::vector<SavedState> states;
+  std::unordered_map<const FleetState *, int32_t> state_row;
+  auto save_state = [this](const FleetState& s) {
+    return SavedState {
+      s.id, s.version, s.published, s.departed, s.x, s.y, s.t, s.velocity, s.distance, s.moving,
+      s.source ? s.source->index : -1, s.destination ? s.destination->index : -1,
+      observer_id(s.owner), s.name ? names.find(s.name) : NameTable::none
+    };
+  };
+  auto state_ref = [&](const std::shared_ptr<const FleetState>& s) {
+    if(not s) {
+      return -1;
+    }
+    auto it = state_row.emplace(s.get(), (int32_t)states.size());
+    if(it.second == true) {
+      states.push_back(save_state(*s));
+    }
+    return it.first->second;
+  };
+
+  std::vector<SavedFleet> saved_fleets;
+  std::vector<int32_t> routes;
+  saved_fleets.reserve(fleets.fleets.size());
+  for(auto&& f : fleets.fleets) {
+    SavedState state = save_state(*f);
+    fleets.position(*f, state.x, state.y, state.t);
+    saved_fleets.push_back(SavedFleet { state, state_ref(f->last_published),
+					(uint32_t)f->path.size(), (uint32_t)f->waypoints.size() });
+    for(auto&& hop : f->path) { routes.push_back(hop.lock()->index); }
+    for(auto&& hop : f->waypoints) { routes.push_back(hop.lock()->index); }
+  }
+  out.add(SaveSection::Fleets, saved_fleets);
+  out.add(SaveSection::FleetRoutes, routes);
+  out.add(SaveSection::DockedAt, fleets.docked_at);
+  out.add(SaveSection::Placed, fleets.placed);
+
+  std::vector<int32_t> snapshots;
+  snapshots.reserve(obs.snapshots.states.size());
+  for(auto&& s : obs.snapshots.states) {
+    snapshots.push_back(state_ref(s));
+  }
+  out.add(SaveSection::Snapshots, snapshots);
+  out.add(SaveSection::SnapshotFree, obs.snapshots.free_slots);
+
+  const EventPool& ev = obs.events;
+  out.add(SaveSection::EventId, ev.id);
+  out.add(SaveSection::EventType, ev.type);
+  out.add(SaveSection::EventX, ev.x);
+  out.add(SaveSection::EventY, ev.y);
+  out.add(SaveSection::EventBirth, ev.birth);
+  out.add(SaveSection::EventSeq, ev.seq);
+  out.add(SaveSection::EventPending, ev.pending);
+  out.add(SaveSection::EventSender, ev.sender);
+  out.add(SaveSection::EventTarget, ev.target);
+  out.add(SaveSection::EventMoveTo, ev.move_to);
+  out.add(SaveSection::EventFleet, ev.fleet);
+  out.add(SaveSection::EventLive, ev.live);
+  out.add(SaveSection::EventLiveIndex, ev.live_index);
+  out.add(SaveSection::EventFree, ev.free_slots);
+  // queues go out drained, in the order they pop
+  std::vector<int> ids;
+  for(auto q = ev.ids; not q.empty(); q.pop()) { ids.push_back(q.top()); }
+  std::vector<uint64_t> retired_words(ev.retired_ids.words.begin(), ev.retired_ids.words.end());
+  out.add(SaveSection::EventIds, ids);
+  out.add(SaveSection::RetiredWords, retired_words);
+
+  std::vector<Delivery> order_deliveries;
+  for(auto q = obs.order_deliveries; not q.empty(); q.pop()) { order_deliveries.push_back(q.top()); }
+  out.add(SaveSection::OrderQueue, obs.order_add_queue);
+  out.add(SaveSection::OrderDeliveries, order_deliveries);
+
+  std::vector<SavedObserver> observers;
+  std::vector<int32_t> known_fleets;
+  std::vector<SavedStarState> known_stars;
+  std::vector<uint64_t> seen_words;
+  std::vector<Delivery> deliveries;
+  for(auto&& o : obs.observers) {
+    SavedObserver r = { o->id, names.find(o->name), o->home->index, o->color.r, o->color.g, o->color.b, 0,
+			o->seen_events.base, (uint32_t)o->known_travelling_fleets.size(),
+			(uint32_t)o->known_idle_fleets.size(), (uint32_t)o->known_stars.size(),
+			(uint32_t)o->seen_events.words.size(), (uint32_t)o->deliveries.size() };
+    observers.push_back(r);
+    for(auto&& f : o->known_travelling_fleets) { known_fleets.push_back(state_ref(f)); }
+    for(auto&& f : o->known_idle_fleets) { known_fleets.push_back(state_ref(f)); }
+    size_t first = known_stars.size();
+    for(auto&& k : o->known_stars) {
+      known_stars.push_back(SavedStarState { k.first, k.second.version, observer_id(k.second.owner) });
+    }
+    // the map has no order of its own, sort so a save is reproducible
+    std::sort(known_stars.begin() + first, known_stars.end(),
+	      [](const SavedStarState& a, const SavedStarState& b) { return a.index < b.index; });
+    seen_words.insert(seen_words.end(), o->seen_events.words.begin(), o->seen_events.words.end());
+    for(auto q = o->deliveries; not q.empty(); q.pop()) { deliveries.push_back(q.top()); }
+  }
+  out.add(SaveSection::Observers, observers);
+  out.add(SaveSection::KnownFleets, known_fleets);
+  out.add(SaveSection::KnownStars, known_stars);
+  out.add(SaveSection::SeenWords, seen_words);
+  out.add(SaveSection::Deliveries, deliveries);
+
+  // last, every state is in by now
+  out.add(SaveSection::States, states);
+
+  out.image(image);
+}
+
+bool Simulation::load(const char *path) {
+  SaveMap in;
+  if(not in.open(path)) {
+    return false;
+  }
+
+  // everything is checked before anything of the running game is thrown away
+  SaveSpan<SavedMeta> meta;
+  SaveSpan<char> name_text, message_text;
+  SaveSpan<SavedStar> saved_stars;
+  SaveSpan<SavedStarState> base, known_stars;
+  SaveSpan<SavedFleet> saved_fleets;
+  SaveSpan<SavedState> saved_states;
+  SaveSpan<int32_t> routes, snapshots, known_fleets;
+  SaveSpan<SavedObserver> saved_observers;
+  SaveSpan<uint64_t> seen_words;
+  SaveSpan<Delivery> deliveries;
+  StarGraph graph(&stars);
+  EventPool events;
+  std::vector<int> docked_at, placed, snapshot_free, ids;
+  std::vector<uint64_t> retired_words;
+  std::vector<ObservableEvent> order_add_queue;
+  std::vector<Delivery> order_deliveries;
+
+  bool ok =
+    in.get(SaveSection::Meta, meta) and meta.size() == 1 and
+    in.get(SaveSection::Names, name_text) and in.get(SaveSection::Messages, message_text) and
+    in.get(SaveSection::Stars, saved_stars) and in.get(SaveSection::StarBase, base) and
+    in.read(SaveSection::LaneStart, graph.lane_start) and in.read(SaveSection::LaneTo, graph.lane_to) and
+    in.read(SaveSection::LaneLength, graph.lane_length) and
+    in.read(SaveSection::StarX, graph.star_x) and in.read(SaveSection::StarY, graph.star_y) and
+    in.get(SaveSection::Fleets, saved_fleets) and in.get(SaveSection::FleetRoutes, routes) and
+    in.read(SaveSection::DockedAt, docked_at) and in.read(SaveSection::Placed, placed) and
+    in.get(SaveSection::States, saved_states) and in.get(SaveSection::Snapshots, snapshots) and
+    in.read(SaveSection::SnapshotFree, snapshot_free) and
+    in.read(SaveSection::EventId, events.id) and in.read(SaveSection::EventType, events.type) and
+    in.read(SaveSection::EventX, events.x) and in.read(SaveSection::EventY, events.y) and
+    in.read(SaveSection::EventBirth, events.birth) and in.read(SaveSection::EventSeq, events.seq) and
+    in.read(SaveSection::EventPending, events.pending) and in.read(SaveSection::EventSender, events.sender) and
+    in.read(SaveSection::EventTarget, events.target) and in.read(SaveSection::EventMoveTo, events.move_to) and
+    in.read(SaveSection::EventFleet, events.fleet) and in.read(SaveSection::EventLive, events.live) and
+    in.read(SaveSection::EventLiveIndex, events.live_index) and in.read(SaveSection::EventFree, events.free_slots) and
+    in.read(SaveSection::EventIds, ids) and in.read(SaveSection::RetiredWords, retired_words) and
+    in.read(SaveSection::OrderQueue, order_add_queue) and
+    in.read(SaveSection::OrderDeliveries, order_deliveries) and
+    in.get(SaveSection::Observers, saved_observers) and
+    in.get(SaveSection::KnownFleets, known_fleets) and in.get(SaveSection::KnownStars, known_stars) and
+    in.get(SaveSection::SeenWords, seen_words) and in.get(SaveSection::Deliveries, deliveries);
+  if(not ok) {
+    return false;
+  }
+
+  // the counts have to add up
+  size_t n = saved_stars.size();
+  size_t route_hops = 0, travelling = 0, idle = 0, known = 0, words = 0, delivered = 0;
+  for(auto&& f : saved_fleets) { route_hops += f.path + f.waypoints; }
+  for(auto&& o : saved_observers) {
+    travelling += o.travelling; idle += o.idle; known += o.known_stars;
+    words += o.seen_words; delivered += o.deliveries;
+  }
+  size_t slots = events.id.size();
+  ok = graph.lane_start.size() == n + 1 and graph.star_x.size() == n and graph.star_y.size() == n and
+    graph.lane_to.size() == graph.lane_length.size() and graph.lane_start[n] == (int)graph.lane_to.size() and
+    route_hops == routes.size() and docked_at.size() == saved_fleets.size() and
+    travelling + idle == known_fleets.size() and known == known_stars.size() and
+    words == seen_words.size() and delivered == deliveries.size() and
+    events.type.size() == slots and events.x.size() == slots and events.y.size() == slots and
+    events.birth.size() == slots and events.seq.size() == slots and events.pending.size() == slots and
+    events.sender.size() == slots and events.target.size() == slots and events.move_to.size() == slots and
+    events.fleet.size() == slots and events.live_index.size() == slots;
+  if(not ok) {
+    return false;
+  }
+
+  // and every index has to be in range of them
+  auto in_range = [](int64_t i, int64_t first, size_t end) { return i >= first and i < (int64_t)end; };
+  // as NameTable::load splits them, the last one ends at the end of the text
+  size_t name_count = name_text.size() == 0 ? 0 : std::count(name_text.begin(), name_text.end() - 1, 0) + 1;
+  auto name = [&](uint32_t id) { return id == NameTable::none or in_range(id, 0, name_count); };
+  // each observer id once, owners have to be one of them
+  std::vector<int32_t> observer_ids;
+  for(auto&& r : saved_observers) {
+    ok = ok and in_range(r.id, 0, meta[0].max_observer_id) and in_range(r.name, 0, name_count) and
+      in_range(r.home, 0, n);
+    observer_ids.push_back(r.id);
+  }
+  std::sort(observer_ids.begin(), observer_ids.end());
+  ok = ok and std::adjacent_find(observer_ids.begin(), observer_ids.end()) == observer_ids.end();
+  auto observer_exists = [&observer_ids](int32_t id) {
+    return std::binary_search(observer_ids.begin(), observer_ids.end(), id);
+  };
+  auto owner = [&](int32_t id) { return id == -1 or observer_exists(id); };
+  ok = ok and observer_exists(meta[0].human_controller);
+
+  for(auto&& r : saved_stars) { ok = ok and in_range(r.name, 0, name_count) and owner(r.owner); }
+  for(auto&& r : base) { ok = ok and owner(r.owner); }
+  for(size_t i = 0; i < n; i++) {
+    ok = ok and graph.lane_start[i] >= 0 and graph.lane_start[i] <= graph.lane_start[i + 1];
+  }
+  for(int to : graph.lane_to) { ok = ok and in_range(to, 0, n); }
+  for(auto&& r : saved_states) {
+    ok = ok and in_range(r.source, -1, n) and in_range(r.destination, -1, n) and name(r.name) and
+      observer_exists(r.owner);
+  }
+  for(auto&& r : saved_fleets) {
+    ok = ok and in_range(r.state.source, 0, n) and in_range(r.state.destination, 0, n) and name(r.state.name) and
+      observer_exists(r.state.owner) and in_range(r.last_published, -1, saved_states.size());
+  }
+  for(int32_t hop : routes) { ok = ok and in_range(hop, 0, n); }
+  for(int star : docked_at) { ok = ok and in_range(star, DockIndex::none, n); }
+  for(int fleet : placed) { ok = ok and in_range(fleet, 0, saved_fleets.size()); }
+  for(int32_t row : snapshots) { ok = ok and in_range(row, -1, saved_states.size()); }
+  for(int slot : snapshot_free) { ok = ok and in_range(slot, 0, snapshots.size()); }
+
+  // events refer to a fleet through a snapshot that has to hold a state,
+  // one with both stars, and to the stars and sender their type uses
+  auto event_ok = [&](const ObservableEvent& e) {
+    if(e.type < ObservableEventType::FleetDeparture or e.type > ObservableEventType::CombatReport or
+       not in_range(e.fleet1, 0, snapshots.size()) or snapshots[e.fleet1] == -1) {
+      return false;
+    }
+    const SavedState& state = saved_states[snapshots[e.fleet1]];
+    bool stars_used = e.type == ObservableEventType::FleetDeparture or e.type == ObservableEventType::FleetArrival or
+      e.type == ObservableEventType::OrderFleetMove;
+    int64_t first = stars_used ? 0 : -1;
+    return state.source >= 0 and state.destination >= 0 and
+      in_range(e.orderTarget, first, n) and in_range(e.orderMoveTo, first, n) and
+      (e.type == ObservableEventType::OrderFleetMove ? observer_exists(e.orderSender) : e.orderSender == -1);
+  };
+  for(EventHandle h : events.live) {
+    ok = ok and in_range(h, 0, slots) and in_range(events.live_index[h], 0, events.live.size()) and
+      event_ok(events.get(h));
+  }
+  for(EventHandle h : events.free_slots) { ok = ok and in_range(h, 0, slots); }
+  for(auto&& e : order_add_queue) { ok = ok and event_ok(e); }
+  for(auto&& d : order_deliveries) { ok = ok and d.observer == -1 and in_range(d.event, 0, slots); }
+  for(int32_t row : known_fleets) { ok = ok and in_range(row, 0, saved_states.size()); }
+  for(auto&& k : known_stars) { ok = ok and in_range(k.index, 0, n) and owner(k.owner); }
+  for(auto&& d : deliveries) { ok = ok and in_range(d.observer, 0, saved_observers.size()) and in_range(d.event, 0, slots); }
+  if(not ok) {
+    return false;
+  }
+
+  // start over, nothing of the old game is kept
+  const SavedMeta& m = meta[0];
+  obs.observers.clear();
+  obs.human_controller.reset();
+  obs.snapshots = FleetSnapshots();
+  fleets.fleets.clear();
+  fleets.by_name.clear();
+  fleets.motion = FleetMotion();
+  fleets.docked = DockIndex();
+  stars.stars.clear();
+  stars.base.clear();
+  stars.by_name.clear();
+  names = NameTable();
+  log = MessageLog();
+
+  t = m.t;
+  generated = m.generated;
+  scenario.stars = m.scenario_stars;
+  scenario.fleets = m.scenario_fleets;
+  scenario.observers = m.scenario_observers;
+  scenario.seed = m.scenario_seed;
+  obs.max_observer_id = m.max_observer_id;
+  obs.max_event_id = m.max_event_id;
+  obs.max_event_seq = m.max_event_seq;
+  obs.tick_events_created = m.tick_events_created;
+  obs.now = m.now;
+  obs.fleet_ticks = m.fleet_ticks;
+
+  names.load(name_text.begin(), name_text.size());
+  for(const char *message : split_strings(message_text)) {
+    log.messages.emplace_back(message);
+  }
+  log.year = m.log_year;
+
+  stars.max_id = m.star_max_id;
+  stars.stars.reserve(n);
+  for(size_t i = 0; i < n; i++) {
+    const SavedStar& r = saved_stars[i];
+    stars.stars.emplace_back(std::make_shared<Star>(names.str(r.name), r.name, r.x, r.y, r.id));
+    stars.stars.back()->index = i;
+    stars.stars.back()->version = r.version;
+    stars.index_name(*stars.stars.back());
+  }
+
+  std::vector<std::shared_ptr<Observer>> by_id;
+  for(size_t i = 0; i < saved_observers.size(); i++) {
+    const SavedObserver& r = saved_observers[i];
+    auto o = std::make_shared<Observer>(names.str(r.name), stars.stars[r.home], Color { r.r, r.g, r.b });
+    o->id = r.id;
+    o->add_stars(stars);
+    obs.observers.push_back(o);
+    if((int)by_id.size() <= r.id) {
+      by_id.resize(r.id + 1);
+    }
+    by_id[r.id] = o;
+  }
+  auto observer = [&by_id](int32_t id) {
+    return id >= 0 and id < (int)by_id.size() ? by_id[id] : nullptr;
+  };
+  obs.human_controller = observer(m.human_controller);
+
+  // the lanes come as they are, neighbors in the same order as lane_to
+  auto& s = stars.stars;
+  for(size_t i = 0; i < n; i++) {
+    s[i]->owner = observer(saved_stars[i].owner);
+    s[i]->neighbors.reserve(graph.lane_start[i + 1] - graph.lane_start[i]);
+    for(int k = graph.lane_start[i]; k < graph.lane_start[i + 1]; k++) {
+      s[i]->neighbors.emplace_back(s[graph.lane_to[k]]);
+    }
+  }
+  for(auto&& r : base) {
+    stars.base.push_back(StarState { r.version, observer(r.owner) });
+  }
+  graph.nodes.assign(n, StarGraph::SearchNode { 0, -1, 0, 0 });
+  graph.route_cache.assign(StarGraph::route_cache_size, StarGraph::CachedRoute());
+  graph.dirty = false;
+  stars.graph = std::move(graph);
+
+  auto load_state = [&](FleetState& f, const SavedState& r) {
+    f.id = r.id; f.version = r.version; f.published = r.published; f.departed = r.departed;
+    f.x = r.x; f.y = r.y; f.t = r.t; f.velocity = r.velocity; f.distance = r.distance;
+    f.moving = r.moving;
+    f.source = r.source >= 0 ? s[r.source] : nullptr;
+    f.destination = r.destination >= 0 ? s[r.destination] : nullptr;
+    f.owner = observer(r.owner);
+    f.name = r.name != NameTable::none ? names.str(r.name) : nullptr;
+  };
+  std::vector<std::shared_ptr<const FleetState>> states;
+  states.reserve(saved_states.size());
+  for(auto&& r : saved_states) {
+    auto state = std::make_shared<FleetState>();
+    load_state(*state, r);
+    states.push_back(std::move(state));
+  }
+  auto state = [&states](int32_t row) {
+    return row >= 0 ? states[row] : nullptr;
+  };
+
+  fleets.max_id = m.fleet_max_id;
+  fleets.fleets.reserve(saved_fleets.size());
+  size_t hop = 0;
+  for(size_t i = 0; i < saved_fleets.size(); i++) {
+    const SavedFleet& r = saved_fleets[i];
+    auto f = std::make_shared<Fleet>(nullptr, s[r.state.source], std::weak_ptr<Observer>());
+    load_state(*f, r.state);
+    f->index = i;
+    f->last_published = state(r.last_published);
+    for(uint32_t k = 0; k < r.path; k++) { f->path.emplace_back(s[routes[hop++]]); }
+    for(uint32_t k = 0; k < r.waypoints; k++) { f->waypoints.emplace_back(s[routes[hop++]]); }
+    fleets.fleets.push_back(f);
+    fleets.by_name.emplace(r.state.name, f);
+    if(f->moving == true) {
+      f->motion = fleets.motion.add(*f);
+    }
+  }
+  fleets.docked_at = std::move(docked_at);
+  fleets.placed = std::move(placed);
+  fleets.docked.build(n, fleets.fleets.size(), [this](int i) { return fleets.docked_at[i]; });
+
+  obs.snapshots.states.reserve(snapshots.size());
+  for(int32_t row : snapshots) {
+    obs.snapshots.states.push_back(state(row));
+  }
+  obs.snapshots.free_slots = std::move(snapshot_free);
+
+  events.ids = decltype(events.ids)(std::greater<int>(), std::move(ids));
+  events.retired_ids.base = m.retired_base;
+  events.retired_ids.words.assign(retired_words.begin(), retired_words.end());
+  obs.events = std::move(events);
+  obs.order_add_queue = std::move(order_add_queue);
+  obs.order_deliveries = DeliveryQueue(std::greater<Delivery>(), std::move(order_deliveries));
+
+  size_t fleet_at = 0, star_at = 0, word_at = 0, delivery_at = 0;
+  for(size_t i = 0; i < saved_observers.size(); i++) {
+    const SavedObserver& r = saved_observers[i];
+    Observer& o = *obs.observers[i];
+    for(uint32_t k = 0; k < r.travelling; k++) { o.known_travelling_fleets.push_back(state(known_fleets[fleet_at++])); }
+    for(uint32_t k = 0; k < r.idle; k++) { o.known_idle_fleets.push_back(state(known_fleets[fleet_at++])); }
+    for(uint32_t k = 0; k < r.known_stars; k++) {
+      const SavedStarState& known_star = known_stars[star_at++];
+      o.known_stars[known_star.index] = StarState { known_star.version, observer(known_star.owner) };
+    }
+    o.seen_events.base = r.seen_base;
+    o.seen_events.words.assign(seen_words.begin() + word_at, seen_words.begin() + word_at + r.seen_words);
+    word_at += r.seen_words;
+    const Delivery *first = deliveries.begin() + delivery_at;
+    o.deliveries = DeliveryQueue(std::greater<Delivery>(), std::vector<Delivery>(first, first + r.deliveries));
+    delivery_at += r.deliveries;
+  }
+  return true;
+}
+
+void Autosave::update(const Simulation& sim) {
+  if(started == INT_MIN) {
+    started = sim.t; // the first one is `every` ticks in
+  }
+  if(every <= 0 or sim.t - started < every or busy() == true) {
+    return;
+  }
+  wait();
+  started = sim.t;
+
+  // the biggest allocation of a save, made here so the child fills it in
+  // place, the game never touches its pages
+  struct stat st;
+  if(stat(path, &st) == 0) {
+    image.reserve(st.st_size);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if(pid == 0) {
+    // The child is a copy of this thread alone, with the game as it was
+    // at the fork. The workers are parked between ticks and hold none of
+    // the game's locks, and fork() leaves malloc and stdio usable in the
+    // child, so it serializes as the game would and writes with system
+    // calls only.
+    sim.serialize(image);
+    _exit(write_save(path, tmp.c_str(), image.data(), image.size()) ? 0 : 1);
+  }
+  auto forked = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(m);
+  last = Report();
+  last.year = sim.t;
+  last.snapshot_ms = std::chrono::duration<double, std::milli>(forked - start).count();
+  if(pid < 0) {
+    last.done = true;
+    return;
+  }
+  child = pid;
+  saves++;
+  waiter = std::thread([this, pid, start]() {
+    int status = 0;
+    while(waitpid(pid, &status, 0) < 0 and errno == EINTR) { }
+    auto end = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m);
+    last.done = true;
+    last.ok = WIFEXITED(status) and WEXITSTATUS(status) == 0;
+    last.write_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    child = -1;
+  });
+}
+
+bool Autosave::busy() {
+  std::lock_guard<std::mutex> lock(m);
+  return child != -1;
+}
+
+Autosave::Report Autosave::report() {
+  std::lock_guard<std::mutex> lock(m);
+  return last;
+}
+
+void Autosave::wait() {
+  if(waiter.joinable()) {
+    waiter.join();
+  }
+}
+
+const uint32_t NameTable::none;
+const size_t NameTable::block_size;
+
+uint32_t NameTable::intern(const char *name) {
+  index();
+  auto it = ids.find(name);
+  if(it != ids.end()) {
+    return it->second;
+  }
+
+  size_t len = strlen(name) + 1;
+  if(block_used + len > block_size) {
+    blocks.emplace_back(new char[std::max(block_size, len)]);
+    block_used = 0;
+  }
+  char *s = blocks.back().get() + block_used;
+  memcpy(s, name, len);
+  block_used += len;
+
+  uint32_t id = strings.size();
+  strings.push_back(s);
+  ids.emplace(s, id);
+  indexed = strings.size();
+  return id;
+}
+
+// one block for the lot, they're looked up by name once something asks
+void NameTable::load(const char *text, size_t size) {
+  assert(strings.empty());
+  if(size == 0) {
+    return;
+  }
+  blocks.emplace_back(new char[size]);
+  block_used = block_size; // full, anything interned later starts a new block
+  char *s = blocks.back().get();
+  memcpy(s, text, size);
+  s[size - 1] = 0;
+
+  strings.reserve(std::count(s, s + size, 0));
+  for(char *end = s + size; s < end; s += strlen(s) + 1) {
+    strings.push_back(s);
+  }
+}
+
+void Stars::init() {
+  stars.reserve(max_stars);
+
+  add("Sol", 100, 100);
+  add("Procyon", 250, 0);
+  add("Epsilon Eridani", 400, 200);
+  add("Tau Ceti", 200, 150);
+  add("Lalande", 90, 250);
+  add("Alpha Centauri", -60, 130);
+  add("Ross 154", -130, 240);
+  add("Cygni", -70, -50);
+  rebuild_indexes();
+
+  std::shared_ptr<Star> sol = from_name("Sol");
+  std::shared_ptr<Star> procyon = from_name("Procyon");
+  std::shared_ptr<Star> epsiloneridani = from_name("Epsilon Eridani");
+  std::shared_ptr<Star> tauceti = from_name("Tau Ceti");
+  std::shared_ptr<Star> lalande = from_name("Lalande");
+  std::shared_ptr<Star> alphacentauri = from_name("Alpha Centauri");
+  std::shared_ptr<Star> ross154 = from_name("Ross 154");
+  std::shared_ptr<Star> cygni = from_name("Cygni");
+
+  graph.s = this;
+  graph.add(sol, tauceti);
+  graph.add(tauceti, lalande);
+  graph.add(tauceti, epsiloneridani);
+  graph.add(sol, procyon);
+  graph.add(procyon, tauceti);
+  graph.add(sol, alphacentauri);
+  graph.add(alphacentauri, ross154);
+  graph.add(alphacentauri, cygni);
+  graph.add(alphacentauri, lalande);
+  graph.add(sol, lalande);
+  graph.add(sol, cygni);
+
+  auto path = graph.pathfind(epsiloneridani, ross154);
+  for(auto&& next : path) {
+    sim_log("-> %s\n", next.lock()->name);
+  }
+}
+
+void StarGraph::add(const std::shared_ptr<Star>& s1, const std::shared_ptr<Star>& s2) {
+  s1->neighbors.emplace_back(s2);
+  s2->neighbors.emplace_back(s1);
+  edits.push_back(s1->index);
+  edits.push_back(s2->index);
+  dirty = true;
+}
+
+void StarGraph::build() const {
+  const auto& stars = s->stars;
+  size_t n = stars.size();
+
+  star_x.resize(n);
+  star_y.resize(n);
+  for(size_t i = 0; i < n; i++) {
+    star_x[i] = stars[i]->x / PX_PER_LIGHTYEAR;
+    star_y[i] = stars[i]->y / PX_PER_LIGHTYEAR;
+  }
+
+  lane_start.resize(n + 1);
+  lane_to.clear();
+  lane_length.clear();
+  for(size_t i = 0; i < n; i++) {
+    lane_start[i] = lane_to.size();
+    for(auto&& neighbor_ : stars[i]->neighbors) {
+      auto neighbor = neighbor_.lock();
+      if(not neighbor) { continue; }
+      float dx = star_x[neighbor->index] - star_x[i];
+      float dy = star_y[neighbor->index] - star_y[i];
+      lane_to.push_back(neighbor->index);
+      lane_length.push_back(sqrt(dx * dx + dy * dy));
+    }
+  }
+  lane_start[n] = lane_to.size();
+
+  if(nodes.size() != n) {
+    nodes.assign(n, SearchNode { 0, -1, 0, 0 });
+    search = 0;
+    route_cache.assign(route_cache_size, CachedRoute());
+  }
+  dirty = false;
+}
+
+bool StarGraph::still_good(CachedRoute& cached) const {
+  for(size_t i = cached.checked; i < edits.size(); i++) {
+    int star = edits[i];
+    if(std::find(cached.path.begin(), cached.path.end(), star) != cached.path.end()) {
+      return false;
+    }
+
+    // any route through the star is at least this long
+    float dx1 = star_x[star] - star_x[cached.from];
+    float dy1 = star_y[star] - star_y[cached.from];
+    float dx2 = star_x[cached.to] - star_x[star];
+    float dy2 = star_y[cached.to] - star_y[star];
+    if(sqrtf(dx1 * dx1 + dy1 * dy1) + sqrtf(dx2 * dx2 + dy2 * dy2) < cached.cost) {
+      return false;
+    }
+  }
+  cached.checked = edits.size();
+  return true;
+}
+
+bool StarGraph::route(int from, int to, std::vector<int>& path) const {
+  if(dirty == true) {
+    build();
+  }
+
+  CachedRoute& cached = route_cache[((size_t)from * 2654435761u + to) % route_cache_size];
+  if(cached.from == from and cached.to == to and still_good(cached)) {
+    route_cache_hits++;
+    path = cached.path;
+    return true;
+  }
+  route_cache_misses++;
+
+  if(not search_route(from, to, path)) {
+    return false;
+  }
+
+  cached.from = from;
+  cached.to = to;
+  cached.cost = nodes[to].cost;
+  cached.checked = edits.size();
+  cached.path = path;
+  return true;
+}
+
+bool StarGraph::search_route(int from, int to, std::vector<int>& path) const {
+  path.clear();
+
+  search++;
+  if(search == 0) {
+    // wrapped around, forget everything
+    for(auto&& node : nodes) { node.seen = 0; node.closed = 0; }
+    search = 1;
+  }
+
+  auto heuristic = [&](int i) {
+    float dx = star_x[to] - star_x[i];
+    float dy = star_y[to] - star_y[i];
+    return sqrtf(dx * dx + dy * dy);
+  };
+  // smallest estimate first, ties by star index so routes are repeatable
+  std::greater<std::pair<float, int>> later;
+
+  open.clear();
+  nodes[from] = SearchNode { 0, -1, search, 0 };
+  open.emplace_back(heuristic(from), from);
+
+  while(not open.empty()) {
+    std::pop_heap(open.begin(), open.end(), later);
+    int cur = open.back().second;
+    open.pop_back();
+
+    if(nodes[cur].closed == search) { continue; } // stale entry
+    nodes[cur].closed = search;
+
+    if(cur == to) {
+      for(int i = to; i != -1; i = nodes[i].parent) { path.push_back(i); }
+      std::reverse(path.begin(), path.end());
+      return true;
+    }
+
+    float cost = nodes[cur].cost;
+    for(int lane = lane_start[cur]; lane < lane_start[cur + 1]; lane++) {
+      int next = lane_to[lane];
+      float next_cost = cost + lane_length[lane];
+      SearchNode& node = nodes[next];
+
+      if(node.seen != search or next_cost < node.cost) {
+	node = SearchNode { next_cost, cur, search, node.closed };
+	open.emplace_back(next_cost + heuristic(next), next);
+	std::push_heap(open.begin(), open.end(), later);
+      }
+    }
+  }
+
+  return false; // no path
+}
+
+std::vector<std::weak_ptr<Star>> StarGraph::pathfind(const std::shared_ptr<Star>& from, const std::shared_ptr<Star>& to) const {
+  if(not route(from->index, to->index, route_buf)) { return {}; }
+
+  std::vector<std::weak_ptr<Star>> ret;
+  ret.reserve(route_buf.size());
+  for(auto&& i : route_buf) { ret.emplace_back(s->stars[i]); }
+  return ret;
+}
+
+const int Sectors::sector_stars;
+const size_t Sectors::transitions;
+const size_t StarGraph::hierarchy_min_stars;
+
+void Sectors::assign(const StarGraph& g) {
+  size_t n = g.star_x.size();
+  float max_x = g.star_x[0], max_y = g.star_y[0];
+  min_x = max_x;
+  min_y = max_y;
+  for(size_t i = 1; i < n; i++) {
+    min_x = std::min(min_x, g.star_x[i]);
+    min_y = std::min(min_y, g.star_y[i]);
+    max_x = std::max(max_x, g.star_x[i]);
+    max_y = std::max(max_y, g.star_y[i]);
+  }
+
+  float area = std::max((max_x - min_x) * (max_y - min_y), 1.0f);
+  side = std::max(sqrtf(area * sector_stars / n), 1.0f);
+  columns = (max_x - min_x) / side + 1;
+  int rows = (max_y - min_y) / side + 1;
+
+  sectors.clear();
+  sectors.resize(columns * rows);
+  portal_of.clear();
+  portal_star.clear();
+  portal_x.clear();
+  portal_y.clear();
+  links.clear();
+  nodes.clear();
+  sector_of.resize(n);
+  slot_of.resize(n);
+  for(size_t i = 0; i < n; i++) {
+    int sector = (int)((g.star_x[i] - min_x) / side) + (int)((g.star_y[i] - min_y) / side) * columns;
+    sector_of[i] = sector;
+    slot_of[i] = sectors[sector].stars.size();
+    sectors[sector].stars.push_back(i);
+  }
+  edits_seen = g.edits.size();
+}
+
+// sectors keep their stars when one is moved, they only have to be close
+void Sectors::apply_edits(const StarGraph& g) {
+  for(; edits_seen < g.edits.size(); edits_seen++) {
+    int star = g.edits[edits_seen];
+    sectors[sector_of[star]].built = false;
+    for(int lane = g.lane_start[star]; lane < g.lane_start[star + 1]; lane++) {
+      sectors[sector_of[g.lane_to[lane]]].built = false;
+    }
+  }
+}
+
+int Sectors::portal(const StarGraph& g, int star) {
+  auto it = portal_of.find(star);
+  if(it != portal_of.end()) {
+    return it->second;
+  }
+
+  int id = portal_star.size();
+  portal_of.emplace(star, id);
+  portal_star.push_back(star);
+  portal_x.push_back(g.star_x[star]);
+  portal_y.push_back(g.star_y[star]);
+  links.emplace_back();
+  nodes.push_back(SearchNode { 0, -1, 0, 0 });
+  return id;
+}
+
+// Dijkstra from `from` without leaving the sector, stopping early once
+// `stop` is settled. Leaves the distances and parents in dist and parent.
+void Sectors::flood(const StarGraph& g, int sector, int from, int stop) {
+  const Sector& sec = sectors[sector];
+  dist.assign(sec.stars.size(), INFINITY);
+  parent.assign(sec.stars.size(), -1);
+  std::greater<std::pair<float, int>> later;
+
+  heap.clear();
+  dist[slot_of[from]] = 0;
+  heap.emplace_back(0, from);
+
+  while(not heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    float cost = heap.back().first;
+    int cur = heap.back().second;
+    heap.pop_back();
+
+    if(cost > dist[slot_of[cur]]) { continue; } // stale entry
+    if(cur == stop) { return; }
+
+    for(int lane = g.lane_start[cur]; lane < g.lane_start[cur + 1]; lane++) {
+      int next = g.lane_to[lane];
+      if(sector_of[next] != sector) { continue; }
+
+      float next_cost = cost + g.lane_length[lane];
+      if(next_cost < dist[slot_of[next]]) {
+	dist[slot_of[next]] = next_cost;
+	parent[slot_of[next]] = cur;
+	heap.emplace_back(next_cost, next);
+	std::push_heap(heap.begin(), heap.end(), later);
+      }
+    }
+  }
+}
+
+void Sectors::build(const StarGraph& g, int sector) {
+  Sector& sec = sectors[sector];
+
+  // every lane leaving the sector, grouped by the sector it goes to.
+  // both sectors sort a border's lanes the same way so they agree on
+  // which ones are transitions.
+  struct Crossing {
+    int other_sector;
+    int lo, hi; // the lane's stars, in index order
+    int star;
+    int other;
+    float length;
+    bool operator<(const Crossing& c) const {
+      return std::tie(other_sector, lo, hi, star) < std::tie(c.other_sector, c.lo, c.hi, c.star);
+    }
+  };
+  std::vector<Crossing> crossings;
+  for(auto&& star : sec.stars) {
+    for(int lane = g.lane_start[star]; lane < g.lane_start[star + 1]; lane++) {
+      int other = g.lane_to[lane];
+      if(sector_of[other] != sector) {
+	crossings.push_back(Crossing { sector_of[other], std::min(star, other), std::max(star, other), star, other, g.lane_length[lane] });
+      }
+    }
+  }
+  std::sort(crossings.begin(), crossings.end());
+
+  for(auto&& p : sec.portals) { links[p].clear(); }
+  sec.portals.clear();
+
+  // the first, middle and last lane of each border
+  std::vector<Link> out;
+  std::vector<int> out_from;
+  for(size_t begin = 0; begin < crossings.size();) {
+    size_t end = begin;
+    while(end < crossings.size() and crossings[end].other_sector == crossings[begin].other_sector) { end++; }
+
+    size_t n = end - begin;
+    size_t m = std::min(n, transitions);
+    for(size_t k = 0; k < m; k++) {
+      const Crossing& c = crossings[begin + (m == 1 ? 0 : k * (n - 1) / (m - 1))];
+      int p = portal(g, c.star);
+      sec.portals.push_back(p);
+      out_from.push_back(p);
+      out.push_back(Link { portal(g, c.other), c.length });
+    }
+    begin = end;
+  }
+  std::sort(sec.portals.begin(), sec.portals.end());
+  sec.portals.erase(std::unique(sec.portals.begin(), sec.portals.end()), sec.portals.end());
+
+  for(size_t i = 0; i < out.size(); i++) {
+    links[out_from[i]].push_back(out[i]);
+  }
+
+  for(auto&& p : sec.portals) {
+    flood(g, sector, portal_star[p], -1);
+    for(auto&& q : sec.portals) {
+      float cost = dist[slot_of[portal_star[q]]];
+      if(q != p and cost < INFINITY) {
+	links[p].push_back(Link { q, cost });
+      }
+    }
+  }
+  sec.built = true;
+}
+
+// A* over the portals, with the route ends joined to the portals of
+// their sectors
+bool Sectors::plan(const StarGraph& g, int from, int to, std::vector<int>& route) {
+  route.clear();
+  int start_sector = sector_of[from];
+  int goal_sector = sector_of[to];
+  if(start_sector == goal_sector) {
+    return false;
+  }
+
+  for(auto&& sector : { start_sector, goal_sector }) {
+    if(sectors[sector].built == false) {
+      build(g, sector);
+    }
+  }
+  int start = portal(g, from);
+  int goal = portal(g, to);
+
+  std::vector<Link> start_links;
+  flood(g, start_sector, from, -1);
+  for(auto&& p : sectors[start_sector].portals) {
+    float cost = dist[slot_of[portal_star[p]]];
+    if(p != start and cost < INFINITY) {
+      start_links.push_back(Link { p, cost });
+    }
+  }
+
+  std::vector<Link> goal_links; // from the goal sector's portals
+  flood(g, goal_sector, to, -1);
+  for(auto&& p : sectors[goal_sector].portals) {
+    float cost = dist[slot_of[portal_star[p]]];
+    if(p != goal and cost < INFINITY) {
+      goal_links.push_back(Link { p, cost });
+    }
+  }
+
+  search++;
+  if(search == 0) {
+    for(auto&& node : nodes) { node.seen = 0; node.closed = 0; }
+    search = 1;
+  }
+
+  // the portal costs are approximate anyway, overestimating a little
+  // keeps the search narrow on big maps for no visible loss
+  float goal_x = portal_x[goal];
+  float goal_y = portal_y[goal];
+  auto heuristic = [&](int p) {
+    float dx = goal_x - portal_x[p];
+    float dy = goal_y - portal_y[p];
+    return 1.1f * sqrtf(dx * dx + dy * dy);
+  };
+  std::greater<std::pair<float, int>> later;
+
+  auto relax = [&](int cur, int next, float cost) {
+    float next_cost = nodes[cur].cost + cost;
+    SearchNode& node = nodes[next];
+    if(node.seen != search or next_cost < node.cost) {
+      node = SearchNode { next_cost, cur, search, node.closed };
+      open.emplace_back(next_cost + heuristic(next), next);
+      std::push_heap(open.begin(), open.end(), later);
+    }
+  };
+
+  open.clear();
+  nodes[start] = SearchNode { 0, -1, search, 0 };
+  open.emplace_back(heuristic(start), start);
+
+  while(not open.empty()) {
+    std::pop_heap(open.begin(), open.end(), later);
+    int cur = open.back().second;
+    open.pop_back();
+
+    if(nodes[cur].closed == search) { continue; } // stale entry
+    nodes[cur].closed = search;
+
+    if(cur == goal) {
+      for(int p = goal; p != -1; p = nodes[p].parent) { route.push_back(portal_star[p]); }
+      std::reverse(route.begin(), route.end());
+      return true;
+    }
+
+    int sector = sector_of[portal_star[cur]];
+    if(sectors[sector].built == false) {
+      build(g, sector); // may add portals, so no references into nodes across this
+    }
+
+    if(cur == start) {
+      for(auto&& link : start_links) { relax(cur, link.portal, link.cost); }
+    }
+    for(auto&& link : links[cur]) { relax(cur, link.portal, link.cost); }
+    if(sector == goal_sector) {
+      for(auto&& link : goal_links) {
+	if(link.portal == cur) { relax(cur, goal, link.cost); }
+      }
+    }
+  }
+
+  return false;
+}
+
+// the hops between two consecutive waypoints of a planned route
+bool Sectors::refine(const StarGraph& g, int from, int to, std::vector<int>& path) {
+  path.clear();
+
+  if(sector_of[from] != sector_of[to]) {
+    // a transition
+    for(int lane = g.lane_start[from]; lane < g.lane_start[from + 1]; lane++) {
+      if(g.lane_to[lane] == to) {
+	path.push_back(from);
+	path.push_back(to);
+	return true;
+      }
+    }
+    return false;
+  }
+
+  flood(g, sector_of[from], from, to);
+  if(dist[slot_of[to]] == INFINITY) {
+    return false;
+  }
+  for(int i = to; i != -1; i = parent[slot_of[i]]) { path.push_back(i); }
+  std::reverse(path.begin(), path.end());
+  return true;
+}
+
+bool StarGraph::plan_route(int from, int to, std::vector<int>& route) const {
+  if(dirty == true) {
+    build();
+  }
+  if(sectors.sector_of.size() != nodes.size()) {
+    sectors.assign(*this);
+  }
+  sectors.apply_edits(*this);
+  return sectors.plan(*this, from, to, route);
+}
+
+std::vector<std::weak_ptr<Star>> StarGraph::plan(const std::shared_ptr<Star>& from, const std::shared_ptr<Star>& to,
+						 std::vector<std::weak_ptr<Star>>& waypoints) const {
+  waypoints.clear();
+  if(s->stars.size() < hierarchy_min_stars or not plan_route(from->index, to->index, route_buf)) {
+    return pathfind(from, to);
+  }
+
+  std::vector<int> route = route_buf;
+  for(size_t i = 2; i < route.size(); i++) {
+    waypoints.emplace_back(s->stars[route[i]]);
+  }
+
+  auto ret = refine(from, s->stars[route[1]]);
+  if(ret.empty()) {
+    waypoints.clear();
+    return pathfind(from, to);
+  }
+  return ret;
+}
+
+std::vector<std::weak_ptr<Star>> StarGraph::refine(const std::shared_ptr<Star>& from, const std::shared_ptr<Star>& to) const {
+  if(dirty == true) {
+    build();
+  }
+  if(sectors.sector_of.size() != nodes.size()) {
+    sectors.assign(*this);
+  }
+
+  if(not sectors.refine(*this, from->index, to->index, route_buf)) {
+    // the sectors only know about routes inside them, try the whole map
+    if(not route(from->index, to->index, route_buf)) { return {}; }
+  }
+
+  std::vector<std::weak_ptr<Star>> ret;
+  ret.reserve(route_buf.size());
+  for(auto&& i : route_buf) { ret.emplace_back(s->stars[i]); }
+  return ret;
+}
+
+void Simulation::init() {
+  stars.init();
+
+  obs.add(Observer(names.str(names.intern("Dv")), stars.from_name("Epsilon Eridani"), Color { 143, 188, 143 }));
+  obs.add(Observer(names.str(names.intern("Xenos")), stars.from_name("Ross 154"), Color { 72, 61, 139 }));
+  // obs.add(Observer("Dv", stars.from_name("Epsilon Eridani"), Color { 255, 0, 0 }));
+  // obs.add(Observer("Xenos", stars.from_name("Ross 154"), Color { 0, 0, 255 }));
+  obs.human_controller = obs.observers.front();
+  std::shared_ptr<Observer> xeno = obs.observers[1];
+
+  stars.from_name("Epsilon Eridani")->set_full_owner(obs.human_controller);
+  stars.from_name("Procyon")->set_full_owner(obs.human_controller);
+
+  stars.from_name("Ross 154")->set_full_owner(xeno);
+  stars.from_name("Alpha Centauri")->set_full_owner(xeno);
+
+  stars.publish_base();
+  obs.human_controller->add_stars(stars);
+  xeno->add_stars(stars);
+
+  fleets.add(Fleet("Epsilon Eridani Fleet", stars.from_name("Epsilon Eridani"), obs.human_controller));
+  fleets.add(Fleet("Lalande Fleet", stars.from_name("Lalande"), obs.human_controller));
+  fleets.add(Fleet("Ross 154 Fleet", stars.from_name("Ross 154"), xeno));
+  fleets.add(Fleet("Alpha Centauri Fleet", stars.from_name("Alpha Centauri"), xeno));
+
+  log.addMessage("Welcome to 2.7 Kelvin!", false);
+}
+
+// Jittered square lattice of stars. Every row is fully connected and the
+// first column links the rows together, so there is always a path between
+// any two stars; the other vertical and diagonal lanes are random.
+void Simulation::generate(const Scenario& sc) {
+  generated = true;
+  scenario = sc;
+  std::mt19937 rng(sc.seed);
+  std::uniform_real_distribution<float> jitter(-0.3, 0.3);
+  std::uniform_real_distribution<float> coin(0, 1);
+  const float spacing = 2 * PX_PER_LIGHTYEAR;
+  const int w = ceil(sqrt(sc.stars));
+  char buf[64];
+
+  stars.stars.reserve(sc.stars);
+  for(int i = 0; i < sc.stars; i++) {
+    snprintf(buf, sizeof(buf), "Star %d", i);
+    stars.add(buf, (i % w + jitter(rng)) * spacing, (i / w + jitter(rng)) * spacing);
+  }
+  stars.rebuild_indexes();
+  stars.graph.s = &stars;
+
+  auto& s = stars.stars;
+  for(int i = 0; i < sc.stars; i++) {
+    int col = i % w;
+    if(col + 1 < w and i + 1 < sc.stars) {
+      stars.graph.add(s[i], s[i + 1]);
+    }
+    if(i + w < sc.stars and (col == 0 or coin(rng) < 0.5)) {
+      stars.graph.add(s[i], s[i + w]);
+    }
+    if(col + 1 < w and i + w + 1 < sc.stars and coin(rng) < 0.2) {
+      stars.graph.add(s[i], s[i + w + 1]);
+    }
+  }
+
+  for(int i = 0; i < sc.observers; i++) {
+    snprintf(buf, sizeof(buf), "Observer %d", i);
+    const char *name = names.str(names.intern(buf));
+    Color c = { (unsigned char)(rng() % 256), (unsigned char)(rng() % 256), (unsigned char)(rng() % 256) };
+    obs.add(Observer(name, s[rng() % s.size()], c));
+    obs.observers.back()->home->set_full_owner(obs.observers.back());
+  }
+  obs.human_controller = obs.observers.front();
+
+  stars.publish_base();
+  for(auto&& o : obs.observers) {
+    o->add_stars(stars);
+  }
+
+  fleets.fleets.reserve(sc.fleets);
+  for(int i = 0; i < sc.fleets; i++) {
+    snprintf(buf, sizeof(buf), "Fleet %d", i);
+    fleets.add(Fleet(buf, s[rng() % s.size()], obs.observers[rng() % obs.observers.size()]));
+  }
+}
+
+void Simulation::tick() {
+  t++;
+  log.year = t;
+  obs.tick_events_created = 0;
+  fleets.update(obs, *this);
+  obs.update(stars.graph, fleets, log);
+  stars.update();
+}
+
+void Simulation::order(const std::shared_ptr<const FleetState>& f, const std::shared_ptr<Star>& from,
+			const std::shared_ptr<Star>& to, const std::shared_ptr<Observer>& o) {
+  if(journal) {
+    Journal::Record r { t, Journal::Type::Order };
+    r.a = f->id; r.b = from->index; r.c = to->index; r.d = o->id;
+    journal->write(r);
+  }
+  obs.addOrderFleetMove(f, from, to, o);
+}
+
+void Simulation::move_star(Star& star, float x, float y) {
+  if(journal) {
+    Journal::Record r { t, Journal::Type::MoveStar };
+    r.a = star.index; r.x = x; r.y = y;
+    journal->write(r);
+  }
+  star.x = x;
+  star.y = y;
+  // wavefront arrival times and lane lengths depend on where the stars are
+  stars.graph.moved(star.index);
+  fleets.moved(star);
+  obs.reschedule();
+}
+
+void Simulation::add_star(const char *name, float x, float y) {
+  if(journal) {
+    Journal::Record r { t, Journal::Type::AddStar };
+    r.x = x; r.y = y; r.name = name;
+    journal->write(r);
+  }
+  stars.add(name, x, y);
+  stars.base.emplace_back(stars.stars.back()->state());
+  stars.graph.dirty = true;
+}
+
+void Simulation::connect(const std::shared_ptr<Star>& s1, const std::shared_ptr<Star>& s2) {
+  if(journal) {
+    Journal::Record r { t, Journal::Type::Connect };
+    r.a = s1->index; r.b = s2->index;
+    journal->write(r);
+  }
+  stars.graph.add(s1, s2);
+}
+
+void Simulation::set_controller(const std::shared_ptr<Observer>& o) {
+  if(journal) {
+    Journal::Record r { t, Journal::Type::Controller };
+    r.a = o->id;
+    journal->write(r);
+  }
+  obs.human_controller = o;
+}
+
+// false for a record that doesn't fit the game, from a journal of another
+// build or one damaged past its checksum
+bool Simulation::apply(const Journal::Record& r) {
+  auto& s = stars.stars;
+  auto star = [&s](int i) { return i >= 0 and i < (int)s.size(); };
+  auto observer = [this](int i) { return i >= 0 and i < (int)obs.observers.size(); };
+  switch(r.type)
+    {
+    case Journal::Type::Order: {
+      if(not star(r.b) or not star(r.c) or not observer(r.d)) {
+	return false;
+      }
+      // the sender's idea of the fleet only matters for its id, and the
+      // fleet may be gone by now. fleets stay sorted by id.
+      std::shared_ptr<const FleetState> state;
+      auto it = std::lower_bound(fleets.fleets.begin(), fleets.fleets.end(), r.a,
+				 [](const std::shared_ptr<Fleet>& f, int id) { return f->id < id; });
+      if(it != fleets.fleets.end() and (*it)->id == r.a) {
+	state = (*it)->publish(obs.fleet_ticks);
+      }
+      else {
+	auto gone = std::make_shared<FleetState>();
+	gone->id = r.a;
+	state = gone;
+      }
+      order(state, s[r.b], s[r.c], obs.observers[r.d]);
+    }; break;
+    case Journal::Type::MoveStar: {
+      if(not star(r.a)) {
+	return false;
+      }
+      move_star(*s[r.a], r.x, r.y);
+    }; break;
+    case Journal::Type::AddStar: { add_star(r.name.c_str(), r.x, r.y); }; break;
+    case Journal::Type::Connect: {
+      if(not star(r.a) or not star(r.b)) {
+	return false;
+      }
+      connect(s[r.a], s[r.b]);
+    }; break;
+    case Journal::Type::Controller: {
+      if(not observer(r.a)) {
+	return false;
+      }
+      set_controller(obs.observers[r.a]);
+    }; break;
+    case Journal::Type::End: { }; break;
+    default: { return false; }; break;
+    }
+  return true;
+}
+
+// FNV-1a over the fleets, what the observers know and the event counters
+uint64_t Simulation::checksum() const {
+  uint64_t h = 14695981039346656037ull;
+  auto mix = [&h](const void *p, size_t n) {
+    const unsigned char *b = (const unsigned char *)p;
+    for(size_t i = 0; i < n; i++) { h = (h ^ b[i]) * 1099511628211ull; }
+  };
+  auto mix_int = [&mix](int v) { mix(&v, sizeof(v)); };
+
+  mix_int(t);
+  mix_int(obs.now);
+  mix_int(obs.max_event_id);
+  mix_int(obs.events.live.size());
+  mix_int(obs.human_controller ? obs.human_controller->id : -1);
+  mix_int(stars.stars.size());
+  for(auto&& f : fleets.fleets) {
+    mix_int(f->id);
+    mix_int(f->version);
+    float x, y, ft;
+    fleets.position(*f, x, y, ft);
+    mix(&x, sizeof(x));
+    mix(&y, sizeof(y));
+    mix(&ft, sizeof(ft));
+    mix_int(f->source->index);
+    mix_int(f->destination->index);
+  }
+  for(auto&& o : obs.observers) {
+    for(auto&& f : o->known_idle_fleets) { mix_int(f->id); mix_int(f->version); }
+    mix_int(-1);
+    for(auto&& f : o->known_travelling_fleets) { mix_int(f->id); mix_int(f->version); }
+    mix_int(-1);
+    mix_int(o->known_stars.size());
+  }
+  return h;
+}
+
+int Simulation::next_event() const {
+  if(not fleets.placed.empty() or not obs.order_add_queue.empty()) {
+    return t + 1;
+  }
+
+  // both in ticks from now, t, obs.now and fleet_ticks all go up by one
+  // a tick
+  long arrival = (long)fleets.motion.next_arrival() - obs.fleet_ticks;
+  long delivery = (long)obs.next_delivery() - obs.now;
+  long next = std::max(1L, std::min(arrival, delivery));
+  return std::min((long)INT_MAX, t + next);
+}
+
+void Simulation::fast_forward(int year) {
+  while(t < year) {
+    // nothing happens until next, only the clocks move
+    int next = std::min(next_event(), year);
+    int idle = next - 1 - t;
+    t += idle;
+    obs.now += idle;
+    obs.fleet_ticks += idle;
+    tick();
+  }
+}
+
+void Simulation::fleetArrived(std::shared_ptr<Fleet>& arrived)
+{
+  // everyone else docked here, the dead are dropped by Fleets::update
+  const DockIndex& docked = fleets.docked;
+  for(int i = docked.first(arrived->source->index); i != DockIndex::none; i = docked.next[i]) {
+    std::shared_ptr<Fleet>& f = fleets.fleets[i];
+    bool encounter = f and f->id != arrived->id;
+
+    if(encounter == true) {
+      // TODO hmm
+      bool is_enemy = f->owner.lock()->id != arrived->owner.lock()->id;
+
+      if(is_enemy == true) {
+	sim_log("%s died at %s\n", f->name, f->source->name);
+	obs.addFleetCombat(f);
+	fleets.stop(*f);
+	f.reset();
+      }
+    }
+  }
+}
+
+void Fleets::update(Observations& obs, Simulation& sim) {
+  obs.fleet_ticks++;
+
+  // move fleets, the travelling ones all at once
+  std::vector<int> arrived_rows;
+  motion.advance(obs.fleet_ticks, arrived_rows);
+  for(int row : arrived_rows) {
+    motion.fleet[row]->arrive(motion);
+  }
+
+  // back to front, stop() moves the last row
+  std::vector<int> arrived_fleets;
+  for(auto it = arrived_rows.rbegin(); it != arrived_rows.rend(); it++) {
+    Fleet& f = *motion.fleet[*it];
+    arrived_fleets.push_back(f.index);
+    stop(f);
+  }
+  arrived_fleets.insert(arrived_fleets.end(), placed.begin(), placed.end());
+  placed.clear();
+
+  // in fleet order, like a pass over fleets would
+  std::sort(arrived_fleets.begin(), arrived_fleets.end());
+  arrived_fleets.erase(std::unique(arrived_fleets.begin(), arrived_fleets.end()), arrived_fleets.end());
+  size_t n = 0;
+  for(int i : arrived_fleets) {
+    auto& fleet = fleets[i];
+    if(fleet->moving == false and fleet->t != 0) {
+      obs.addFleetArrival(fleet);
+      fleet->t = 0;
+      fleet->version++;
+      docked_at[i] = fleet->source->index;
+      arrived_fleets[n++] = i;
+    }
+  }
+  arrived_fleets.resize(n);
+
+  // process combat
+  auto star_of = [this](int i) { return docked_at[i]; };
+  docked.build(sim.stars.stars.size(), fleets.size(), star_of);
+  for(int i : arrived_fleets) {
+    if(fleets[i]) {
+      sim.fleetArrived(fleets[i]);
+    }
+  }
+
+  // move surviving ships on paths, only the ones that just arrived can be
+  // at a stop along one
+  for(int i : arrived_fleets) {
+    auto& fleet = fleets[i];
+    if(not fleet) {
+      continue;
+    }
+
+    if(fleet->path.size() == 1 and not fleet->waypoints.empty()) {
+      fleet->next_leg(sim.stars.graph);
+    }
+
+    if(not fleet->path.empty()) {
+      if(fleet->path.size() == 1) { // it is what it is
+	fleet->path.clear();
+	fleet->source = fleet->destination;
+	fleet->t = 0;
+	fleet->version++;
+	docked_at[i] = fleet->source->index;
+	continue;
+      }
+
+      if(auto next = fleet->path.front().lock()) {
+	fleet->move_to(sim.stars.graph, next);
+	launch(*fleet, obs.fleet_ticks);
+	obs.addFleetDeparture(fleet);
+      }
+    }
+  }
+
+  // drop the dead
+  n = 0;
+  for(size_t i = 0; i < fleets.size(); i++) {
+    if(fleets[i]) {
+      if(n != i) {
+	fleets[n] = std::move(fleets[i]);
+	docked_at[n] = docked_at[i];
+	fleets[n]->index = n;
+      }
+      n++;
+    }
+  }
+  fleets.resize(n);
+  docked_at.resize(n);
+
+  docked.build(sim.stars.stars.size(), fleets.size(), star_of);
+}
+
+void Fleet::move_to(const StarGraph& g, std::shared_ptr<Star>& d) {
+  // check if d is a neighbor of the fleet's star
+  bool direct = false;
+  for(auto&& neighbor : source->neighbors) {
+    if(auto n = neighbor.lock()) {
+      if(n->id == d->id) { direct = true; }
+    }
+  }
+
+  if(direct == false) {
+    if(path.empty()) {
+      path = g.plan(source, d, waypoints);
+    }
+    sim_log("*** path:");
+    for(auto&& p : path) sim_log(" %s", p.lock()->name);
+    sim_log("\n\n");
+
+    if(path.empty()) {
+      sim_log("Fail whale: Couldn't find path from %s to %s\n", source->name, d->name);
+      return;
+    }
+
+    path.erase(path.begin());
+    if(auto dest = path.front().lock()) {
+      source = destination;
+      destination = dest;
+      sim_log("%s -> %s\n\n", source->name, destination->name);
+    }
+    else {
+      exit(1);
+    }
+  }
+  else {
+    destination = d;
+  }
+
+  distance =
+    sqrt((source->x - destination->x) * (source->x - destination->x) +
+	 (source->y - destination->y) * (source->y - destination->y));
+
+  moving = true;
+  t = 0;
+  version++;
+}
+
+// refine the route to the next waypoint, we're at the end of the last leg
+void Fleet::next_leg(const StarGraph& g) {
+  auto from = path.front().lock();
+  auto to = waypoints.front().lock();
+  waypoints.erase(waypoints.begin());
+
+  std::vector<std::weak_ptr<Star>> leg;
+  if(from and to) {
+    leg = g.refine(from, to);
+  }
+  if(leg.empty()) {
+    sim_log("Fail whale: %s lost its route at %s\n", name, source->name);
+    waypoints.clear();
+    return;
+  }
+  path = std::move(leg);
+}
+
+const int FleetTrace::capacity;
+const int DockIndex::none;
+
+// the fleet's row in FleetMotion reached the end of the leg
+void Fleet::arrive(const FleetMotion& m) {
+  t = m.t[motion];
+  source = destination;
+  x = source->x;
+  y = source->y;
+  moving = false;
+  version++;
+}
+
+// t is worked out the same way as FleetState::progress and the lerps
+// are spelled out like lerp() so positions match FleetState::at bit for
+// bit, observers replay fleets with that.
+void FleetMotion::advance(int ticks, std::vector<int>& arrived) {
+  size_t n = size();
+  size_t i = 0;
+  float *T = t.data(), *X = x.data(), *Y = y.data();
+  const float *DT = dt.data(), *SX = sx.data(), *SY = sy.data(), *DX = dx.data(), *DY = dy.data();
+  const int *D = departed.data();
+
+#if defined(__AVX2__)
+  const __m256 one8 = _mm256_set1_ps(1);
+  const __m256i now8 = _mm256_set1_epi32(ticks);
+  for(; i + 8 <= n; i += 8) {
+    __m256 k = _mm256_cvtepi32_ps(_mm256_sub_epi32(now8, _mm256_loadu_si256((const __m256i *)(D + i))));
+    __m256 tt = _mm256_mul_ps(k, _mm256_loadu_ps(DT + i));
+    __m256 rest = _mm256_sub_ps(one8, tt);
+    _mm256_storeu_ps(T + i, tt);
+    _mm256_storeu_ps(X + i, _mm256_add_ps(_mm256_mul_ps(rest, _mm256_loadu_ps(SX + i)),
+					  _mm256_mul_ps(tt, _mm256_loadu_ps(DX + i))));
+    _mm256_storeu_ps(Y + i, _mm256_add_ps(_mm256_mul_ps(rest, _mm256_loadu_ps(SY + i)),
+					  _mm256_mul_ps(tt, _mm256_loadu_ps(DY + i))));
+    for(int mask = _mm256_movemask_ps(_mm256_cmp_ps(tt, one8, _CMP_GE_OQ)); mask; mask &= mask - 1) {
+      arrived.push_back(i + __builtin_ctz(mask));
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128 one4 = _mm_set1_ps(1);
+  const __m128i now4 = _mm_set1_epi32(ticks);
+  for(; i + 4 <= n; i += 4) {
+    __m128 k = _mm_cvtepi32_ps(_mm_sub_epi32(now4, _mm_loadu_si128((const __m128i *)(D + i))));
+    __m128 tt = _mm_mul_ps(k, _mm_loadu_ps(DT + i));
+    __m128 rest = _mm_sub_ps(one4, tt);
+    _mm_storeu_ps(T + i, tt);
+    _mm_storeu_ps(X + i, _mm_add_ps(_mm_mul_ps(rest, _mm_loadu_ps(SX + i)), _mm_mul_ps(tt, _mm_loadu_ps(DX + i))));
+    _mm_storeu_ps(Y + i, _mm_add_ps(_mm_mul_ps(rest, _mm_loadu_ps(SY + i)), _mm_mul_ps(tt, _mm_loadu_ps(DY + i))));
+    for(int mask = _mm_movemask_ps(_mm_cmpge_ps(tt, one4)); mask; mask &= mask - 1) {
+      arrived.push_back(i + __builtin_ctz(mask));
+    }
+  }
+#endif
+  for(; i < n; i++) {
+    T[i] = (ticks - D[i]) * DT[i];
+    X[i] = lerp(SX[i], DX[i], T[i]);
+    Y[i] = lerp(SY[i], DY[i], T[i]);
+    if(T[i] >= 1) {
+      arrived.push_back(i);
+    }
+  }
+}
+
+void FleetState::trace(int ticks, FleetTrace& out) const {
+  out.clear();
+  if(moving == false) {
+    return;
+  }
+
+  // one sample every `spacing` ticks of travel, only the last ones fit
+  int spacing = std::max(g_fleet_trace_spacing, 1);
+  int last = (ticks - departed) / spacing;
+  int first = std::max(1, last - FleetTrace::capacity + 1);
+
+  for(int n = first; n <= last; n++) {
+    float tt = progress(departed + n * spacing);
+    if(tt >= 1) {
+      break;
+    }
+    out.add(lerp(source->x, destination->x, tt), lerp(source->y, destination->y, tt), departed + n * spacing);
+  }
+}
@@ -0,0 +1,1363 @@
+#pragma once
+
+// Simulation core: stars, hyperlanes, fleets and the light-speed
+// propagation of events between observers. Nothing in here may depend on
+// Allegro or ImGui so that it can be built into the headless 27kelvin-sim.
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <sstream>
+#include <string>
+#include <random>
+#include <queue>
+#include <functional>
+#include <type_traits>
+#include <tuple>
+#include <unordered_map>
+
+#include <sys/types.h>
+
+const float PX_PER_LIGHTYEAR = 50;
+
+struct Observer;
+struct Fleet;
+struct Star;
+
+extern bool g_draw_fleet_traces;
+extern int g_fleet_trace_spacing; // ticks between fleet trace samples
+extern bool g_sim_log; // the simulation is chatty, turn this off when running headless
+extern int g_sim_threads; // workers for Observations::update, -1 for one per extra core
+
+#define sim_log(...) do { if(g_sim_log) { printf(__VA_ARGS__); } } while(0)
+
+const char *get_fleet_name(const Fleet& f);
+const char *get_observer_name(const Observer& o);
+float distance_to_star(const Observer& o, const Star& s);
+
+static inline float lerp(float v0, float v1, float t) {
+  return (1 - t) * v0 + t * v1;
+}
+
+struct Color {
+  unsigned char r, g, b;
+};
+
+// Interned names. Each distinct name is copied once into a block arena
+// that is only freed as a whole, so the pointers stay valid as long as
+// the table, and gets a 32-bit id in the order it was first seen.
+struct NameTable {
+  static const uint32_t none = UINT32_MAX;
+  static const size_t block_size = 16384;
+
+  struct Hash {
+    size_t operator()(const char *s) const {
+      // FNV-1a
+      size_t h = 2166136261u;
+      for(; *s; s++) { h = (h ^ (unsigned char)*s) * 16777619u; }
+      return h;
+    }
+  };
+
+  struct Equal {
+    bool operator()(const char *a, const char *b) const { return strcmp(a, b) == 0; }
+  };
+
+  std::vector<std::unique_ptr<char[]>> blocks;
+  size_t block_used = block_size;
+  std::vector<const char *> strings; // by id
+  // by name, for the first `indexed` strings. load leaves the rest to
+  // the first lookup.
+  mutable std::unordered_map<const char *, uint32_t, Hash, Equal> ids;
+  mutable size_t indexed = 0;
+
+  uint32_t intern(const char *name);
+  // Names one after the other, NUL terminated and all different, given
+  // the ids they're in the order of. Only for an empty table.
+  void load(const char *text, size_t size);
+
+  void index() const {
+    if(indexed < strings.size()) {
+      ids.reserve(strings.size());
+      for(; indexed < strings.size(); indexed++) { ids.emplace(strings[indexed], indexed); }
+    }
+  }
+
+  uint32_t find(const char *name) const {
+    index();
+    auto it = ids.find(name);
+    return it == ids.end() ? none : it->second;
+  }
+
+  const char *str(uint32_t id) const {
+    return strings[id];
+  }
+};
+
+// What can be learned about a star, as of some version of it
+struct StarState {
+  int version;
+  std::weak_ptr<Observer> owner;
+};
+
+struct Star {
+  int id;
+  int index = 0; // index into the stars vector
+  const char *name; // interned in Stars::names
+  uint32_t name_id;
+  // star position
+  float x, y;
+  // size of its label on the map, set when it is first drawn
+  float wx = 0;
+  float wy = 0;
+  int focus = 0;
+  std::weak_ptr<Observer> owner;
+  std::vector<std::weak_ptr<Star>> neighbors;
+  bool moving = false;
+  int version = 0; // bumped whenever the StarState changes
+
+  // only used by struct Stars
+  Star(const char *_name, uint32_t _name_id, float _x, float _y, int _id) {
+    name = _name; name_id = _name_id; x = _x; y = _y; id = _id;
+  }
+
+  void update() {
+  }
+
+  void set_full_owner(std::shared_ptr<Observer>& o) {
+    owner = o;
+    version++;
+  }
+
+  StarState state() const {
+    return StarState { version, owner };
+  }
+};
+
+struct Stars;
+
+struct StarGraph;
+
+// HPA* style abstraction of the lane graph for routing on big maps.
+// Stars are binned into square sectors of about sector_stars stars each.
+// A few of the lanes crossing between two sectors are transitions and
+// their ends are the sectors' portals. Long routes are planned from
+// portal to portal over the transitions and, inside a sector, the
+// shortest in-sector distance between its portals, worked out the first
+// time a route passes through the sector and again after an edit touches
+// it. The route is then refined one sector at a time.
+struct Sectors {
+  static const int sector_stars = 1024;
+  static const size_t transitions = 3; // per pair of neighbouring sectors
+
+  struct Link {
+    int portal;
+    float cost;
+  };
+
+  struct Sector {
+    std::vector<int> stars;
+    bool built = false;
+    std::vector<int> portals;
+  };
+
+  float side = 0; // light years
+  int columns = 0;
+  float min_x = 0, min_y = 0;
+  std::vector<int> sector_of; // by star index
+  std::vector<int> slot_of; // index into Sector::stars
+  std::vector<Sector> sectors;
+  size_t edits_seen = 0;
+
+  // Portals get small ids the first time they're seen so the abstract
+  // search works on compact arrays. Route ends get one too.
+  std::unordered_map<int, int> portal_of; // by star index
+  std::vector<int> portal_star;
+  std::vector<float> portal_x, portal_y;
+  std::vector<std::vector<Link>> links; // by portal, while its sector is built
+
+  // workspace for the abstract search, by portal
+  struct SearchNode {
+    float cost;
+    int parent;
+    uint32_t seen;
+    uint32_t closed;
+  };
+  std::vector<SearchNode> nodes;
+  uint32_t search = 0;
+  std::vector<std::pair<float, int>> open;
+
+  // scratch for searches inside one sector, by slot
+  std::vector<float> dist;
+  std::vector<int> parent;
+  std::vector<std::pair<float, int>> heap;
+
+  void assign(const StarGraph& g);
+  void apply_edits(const StarGraph& g);
+  int portal(const StarGraph& g, int star);
+  void build(const StarGraph& g, int sector);
+  void flood(const StarGraph& g, int sector, int from, int stop);
+  bool plan(const StarGraph& g, int from, int to, std::vector<int>& route);
+  bool refine(const StarGraph& g, int from, int to, std::vector<int>& path);
+};
+
+struct StarGraph {
+  Stars* s;
+
+  StarGraph() = default;
+  StarGraph(Stars* _s) {
+    s = _s;
+  }
+
+  std::vector<std::weak_ptr<Star>> shown_path;
+
+  // Hyperlanes in compressed sparse row form, rebuilt from Star::neighbors
+  // on the next search after a lane is added or a star moves. The lanes
+  // of the star at index i are lane_to[lane_start[i]] up to
+  // lane_to[lane_start[i + 1]].
+  mutable bool dirty = true;
+  mutable std::vector<int> lane_start;
+  mutable std::vector<int> lane_to;
+  mutable std::vector<float> lane_length; // light years
+  mutable std::vector<float> star_x, star_y; // light years, for the heuristic
+
+  // A* workspace kept between searches. Entries are only valid for the
+  // search whose number is in `seen`, so nothing is cleared per search.
+  struct SearchNode {
+    float cost;
+    int parent;
+    uint32_t seen;
+    uint32_t closed;
+  };
+  mutable std::vector<SearchNode> nodes;
+  mutable uint32_t search = 0;
+  mutable std::vector<std::pair<float, int>> open;
+  mutable std::vector<int> route_buf;
+
+  // Routes found before, in a direct mapped table by (from, to). Every
+  // star that gains a lane or moves is appended to `edits`, so its size
+  // is the graph generation. An entry older than that is checked against
+  // the newer edits when it's looked up, and only dropped if one of them
+  // is on the route or could be part of a shorter one.
+  struct CachedRoute {
+    int from = -1;
+    int to = -1;
+    float cost = 0;
+    size_t checked = 0; // edits.size() when last known to be good
+    std::vector<int> path;
+  };
+  static const size_t route_cache_size = 4096;
+  mutable std::vector<CachedRoute> route_cache;
+  mutable long route_cache_hits = 0;
+  mutable long route_cache_misses = 0;
+  std::vector<int> edits; // star indexes
+
+  void add(const std::shared_ptr<Star>& s1, const std::shared_ptr<Star>& s2);
+  void moved(int index) { edits.push_back(index); dirty = true; }
+  void build() const;
+
+  // Shortest route by distance, which is also the fastest since travel
+  // time is distance over velocity. Star indexes from `from` to `to`.
+  bool route(int from, int to, std::vector<int>& path) const;
+  bool search_route(int from, int to, std::vector<int>& path) const;
+  bool still_good(CachedRoute& cached) const;
+  std::vector<std::weak_ptr<Star>> pathfind(const std::shared_ptr<Star>& from, const std::shared_ptr<Star>& to) const;
+
+  // Below this many stars every route is searched in one go
+  static const size_t hierarchy_min_stars = 50000;
+  mutable Sectors sectors;
+
+  // Portals a long route passes through, from `from` to `to`. False if
+  // the two are in the same sector or no route was found that way.
+  bool plan_route(int from, int to, std::vector<int>& route) const;
+
+  // The hops to the first waypoint of a route, the rest of the waypoints
+  // are left for refine as the fleet gets to them
+  std::vector<std::weak_ptr<Star>> plan(const std::shared_ptr<Star>& from, const std::shared_ptr<Star>& to,
+					std::vector<std::weak_ptr<Star>>& waypoints) const;
+  std::vector<std::weak_ptr<Star>> refine(const std::shared_ptr<Star>& from, const std::shared_ptr<Star>& to) const;
+};
+
+struct Stars {
+  int max_id = 0;
+  const size_t max_stars = 128;
+  std::vector<std::shared_ptr<Star>> stars;
+  std::vector<StarState> base; // the map every observer starts out with, by index
+  StarGraph graph;
+  NameTable *names;
+  std::vector<int> by_name; // star index by name id, -1 if not a star
+
+  Stars() {
+    stars.reserve(64);
+  }
+
+  void update() {
+    for(auto&& star : stars) { star->update(); }
+  }
+
+  void add(const char *name) {
+    add(name, 0, 0);
+  }
+
+  void add(const char *name, float _x, float _y) {
+    uint32_t name_id = names->intern(name);
+    stars.emplace_back(std::make_shared<Star>(Star(names->str(name_id), name_id, _x, _y, max_id)));
+    stars.back()->index = stars.size() - 1;
+    index_name(*stars.back());
+    max_id++;
+    sim_log("stars.size(): %ld\n", stars.size());
+  }
+
+  void index_name(const Star& star) {
+    if(by_name.size() <= star.name_id) {
+      by_name.resize(star.name_id + 1, -1);
+    }
+    // the first star with a name keeps it
+    if(by_name[star.name_id] == -1 or by_name[star.name_id] > star.index) {
+      by_name[star.name_id] = star.index;
+    }
+  }
+
+  std::shared_ptr<Star> from_name(const char *name) {
+    uint32_t id = names->find(name);
+    if(id == NameTable::none or id >= by_name.size() or by_name[id] == -1) {
+      return NULL;
+    }
+    return stars[by_name[id]];
+  }
+
+  void connect(const char *name1, const char *name2) {
+    graph.add(from_name(name1), from_name(name2));
+  }
+
+  void rebuild_indexes() {
+    int i = 0;
+    for(auto&& star : stars) {
+      star->index = i;
+      i++;
+    }
+    std::fill(by_name.begin(), by_name.end(), -1);
+    for(auto&& star : stars) { index_name(*star); }
+  }
+
+  void publish_base() {
+    base.clear();
+    base.reserve(stars.size());
+    for(auto&& star : stars) { base.emplace_back(star->state()); }
+  }
+
+  void init();
+};
+
+/*
+ * Other events?
+ *
+ *   observer requests general status report?
+ *
+ */
+
+enum class ObservableEventType { FleetDeparture, FleetArrival, FleetIdle, OrderFleetMove, CombatReport };
+
+// Plain data so that it can be pooled and copied around freely: stars,
+// fleets and observers are referred to by number, -1 if unused.
+struct ObservableEvent {
+  ObservableEvent(ObservableEventType _type, float _x, float _y, int _id) {
+    id = _id;
+    type = _type;
+    x = _x;
+    y = _y;
+    birth = 0;
+    seq = -1;
+    pending = 0;
+    orderSender = -1;
+    orderTarget = -1;
+    orderMoveTo = -1;
+    fleet1 = -1;
+  }
+
+  int id;
+  ObservableEventType type;
+  float x, y;
+  int birth; // Observations::now when the wavefront had radius 0
+  int seq; // creation order, set by Observations::schedule
+  int pending; // deliveries still scheduled, retired at 0
+
+  int orderSender; // observer id
+  int orderTarget; // star index
+  int orderMoveTo; // star index
+  int fleet1; // handle into Observations::snapshots
+};
+
+static_assert(std::is_trivially_copyable<ObservableEvent>::value, "events are pooled as plain data");
+
+typedef uint32_t EventHandle;
+
+// The wavefront of event seq reaches an observer (or an order its target
+// star) at tick. Events are ordered by seq and then by observer so that
+// deliveries due on the same tick are handled in creation order.
+struct Delivery {
+  int tick;
+  int seq;
+  int observer; // index into Observations::observers, -1 for orders
+  EventHandle event;
+
+  bool operator>(const Delivery& o) const {
+    if(tick != o.tick) { return tick > o.tick; }
+    if(seq != o.seq) { return seq > o.seq; }
+    return observer > o.observer;
+  }
+};
+
+typedef std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery>> DeliveryQueue;
+
+// Which events an observer has already handled. Event ids only go up, so
+// this is a bitset over a window of ids starting at the oldest event that
+// is still in flight; everything below the window has been retired.
+struct SeenEvents {
+  int base = 0; // id of the first bit, a multiple of 64
+  std::deque<uint64_t> words;
+
+  bool has(int id) const {
+    if(id < base) { return false; }
+    size_t w = (id - base) / 64;
+    if(w >= words.size()) { return false; }
+    return (words[w] >> ((id - base) % 64)) & 1;
+  }
+
+  void add(int id) {
+    assert(id >= base);
+    size_t w = (id - base) / 64;
+    if(w >= words.size()) { words.resize(w + 1, 0); }
+    words[w] |= (uint64_t)1 << ((id - base) % 64);
+  }
+
+  void remove(int id) {
+    if(id < base) { return; }
+    size_t w = (id - base) / 64;
+    if(w >= words.size()) { return; }
+    words[w] &= ~((uint64_t)1 << ((id - base) % 64));
+  }
+
+  // slide the window up to the oldest event id still in flight
+  void retire_below(int oldest) {
+    while(not words.empty() and base + 64 <= oldest) {
+      words.pop_front();
+      base += 64;
+    }
+    if(words.empty()) {
+      base = std::max(base, oldest - oldest % 64);
+    }
+  }
+};
+
+// Events in flight, stored column by column. A handle is a slot number
+// and stays valid until the event is retired, after which the slot is
+// reused. live lists the slots in use and is kept dense by swap-remove.
+struct EventPool {
+  std::vector<int> id;
+  std::vector<ObservableEventType> type;
+  std::vector<float> x, y;
+  std::vector<int> birth;
+  std::vector<int> seq;
+  std::vector<int> pending;
+  std::vector<int> sender, target, move_to, fleet;
+
+  std::vector<EventHandle> live;
+  std::vector<uint32_t> live_index; // position of each slot in live
+  std::vector<EventHandle> free_slots;
+
+  // ids in flight, with retired ones popped lazily by oldest_id
+  std::priority_queue<int, std::vector<int>, std::greater<int>> ids;
+  SeenEvents retired_ids;
+
+  size_t size() const {
+    return live.size();
+  }
+
+  EventHandle add(const ObservableEvent& e) {
+    EventHandle h;
+    if(not free_slots.empty()) {
+      h = free_slots.back();
+      free_slots.pop_back();
+    }
+    else {
+      h = id.size();
+      id.push_back(0); type.push_back(e.type); x.push_back(0); y.push_back(0);
+      birth.push_back(0); seq.push_back(0); pending.push_back(0);
+      sender.push_back(0); target.push_back(0); move_to.push_back(0); fleet.push_back(0);
+      live_index.push_back(0);
+    }
+    id[h] = e.id; type[h] = e.type; x[h] = e.x; y[h] = e.y;
+    birth[h] = e.birth; seq[h] = e.seq; pending[h] = e.pending;
+    sender[h] = e.orderSender; target[h] = e.orderTarget; move_to[h] = e.orderMoveTo; fleet[h] = e.fleet1;
+
+    live_index[h] = live.size();
+    live.push_back(h);
+    ids.push(e.id);
+    return h;
+  }
+
+  ObservableEvent get(EventHandle h) const {
+    ObservableEvent e(type[h], x[h], y[h], id[h]);
+    e.birth = birth[h]; e.seq = seq[h]; e.pending = pending[h];
+    e.orderSender = sender[h]; e.orderTarget = target[h]; e.orderMoveTo = move_to[h]; e.fleet1 = fleet[h];
+    return e;
+  }
+
+  void remove(EventHandle h) {
+    EventHandle last = live.back();
+    live[live_index[h]] = last;
+    live_index[last] = live_index[h];
+    live.pop_back();
+    free_slots.push_back(h);
+    retired_ids.add(id[h]);
+  }
+
+  // oldest event id still in flight, or none if there are no events
+  int oldest_id(int none) {
+    while(not ids.empty() and retired_ids.has(ids.top())) {
+      ids.pop();
+    }
+    int oldest = ids.empty() ? none : ids.top();
+    retired_ids.retire_below(oldest);
+    return oldest;
+  }
+};
+
+struct Observations;
+
+// Where a fleet has been, sampled every g_fleet_trace_spacing ticks into
+// a bounded ring. Filled from a FleetState when it's drawn, see
+// FleetState::trace. The radius of a sample's wavefront is the time
+// since its tick.
+struct FleetTrace {
+  static const int capacity = 32;
+
+  struct Sample {
+    float x, y;
+    int tick; // Observations::fleet_ticks
+  };
+
+  Sample samples[capacity];
+  int head = 0; // where the next sample goes
+  int count = 0;
+
+  void clear() { count = 0; }
+  int size() const { return count; }
+
+  void add(float x, float y, int tick) {
+    samples[head] = Sample { x, y, tick };
+    head = (head + 1) % capacity;
+    count = std::min(count + 1, capacity);
+  }
+
+  // oldest first
+  const Sample& operator[](int i) const {
+    return samples[(head - count + i + capacity) % capacity];
+  }
+
+  const Sample& back() const {
+    return (*this)[count - 1];
+  }
+};
+
+// What others can know about a fleet. States published for events are
+// immutable and shared by the event and every observer that sees it; the
+// fleet publishes a new one only when it changes course or docks.
+struct FleetState {
+  int id;
+  int version = 0; // bumped on every change other than travelling along
+  int published = 0; // Observations::fleet_ticks when this was published
+  int departed = 0; // Observations::fleet_ticks when the leg started
+  float x, y;
+  float t; // -1 if in star system
+  float velocity;
+  float distance;
+  bool moving;
+
+  std::shared_ptr<Star> source;
+  std::shared_ptr<Star> destination;
+  std::weak_ptr<Observer> owner;
+
+  const char *name;
+
+  // how far along the leg one tick gets
+  float step() const { return (velocity * PX_PER_LIGHTYEAR) / distance; }
+
+  // t at fleet tick `ticks`. A closed form rather than a sum so skipping
+  // ahead lands exactly where stepping would, see Simulation::fast_forward.
+  float progress(int ticks) const { return (ticks - departed) * step(); }
+
+  // the fleet tick the leg ends on
+  int arrival() const {
+    float dt = step();
+    int k = std::max(1.0f, ceilf(1 / dt));
+    while(k > 1 and (k - 1) * dt >= 1) { k--; }
+    while(k * dt < 1) { k++; }
+    return departed + k;
+  }
+
+  // The samples a trace would have at fleet tick `ticks`, one every
+  // g_fleet_trace_spacing ticks since the leg started
+  void trace(int ticks, FleetTrace& out) const;
+
+  // Where the fleet is at fleet tick `ticks` if nothing changed since
+  // this was published
+  FleetState at(int ticks) const {
+    FleetState s = *this;
+    s.published = ticks;
+    if(moving == false) {
+      return s;
+    }
+
+    s.t = progress(ticks);
+    if(s.t >= 1) {
+      s.source = destination;
+      s.x = destination->x;
+      s.y = destination->y;
+      s.moving = false;
+    }
+    else {
+      s.x = lerp(source->x, destination->x, s.t);
+      s.y = lerp(source->y, destination->y, s.t);
+    }
+    return s;
+  }
+};
+
+struct FleetMotion;
+
+// While a fleet travels, x, y and t are where it was when it set off and
+// where it is now is in its row of Fleets::motion, see Fleets::position.
+// Nothing in flight publishes a new state, so FleetState copies never
+// see the stale ones.
+struct Fleet : FleetState {
+  int index; // into Fleets::fleets
+  int motion = -1; // row in Fleets::motion while travelling
+  std::vector<std::weak_ptr<Star>> path; // the path we're on
+  std::vector<std::weak_ptr<Star>> waypoints; // the rest of a long route, see StarGraph::plan
+
+  std::shared_ptr<const FleetState> last_published;
+
+  Fleet(const char *_name, std::shared_ptr<Star> s, std::weak_ptr<Observer> _owner) {
+    name = _name;
+    source = s;
+    x = source->x;
+    y = source->y;
+    destination = source;
+    t = -1;
+    moving = false;
+    owner = _owner;
+    velocity = 0.75;
+  }
+
+  const std::shared_ptr<const FleetState>& publish(int ticks) {
+    if(not last_published or last_published->version != version) {
+      auto state = std::make_shared<FleetState>(*this);
+      state->published = ticks;
+      last_published = std::move(state);
+    }
+    return last_published;
+  }
+
+  void move_to(const StarGraph &g, std::shared_ptr<Star>& d);
+  void next_leg(const StarGraph &g);
+  void arrive(const FleetMotion& m);
+};
+
+// Kinematics of the travelling fleets as parallel arrays, so a tick is one
+// pass over contiguous floats and only the fleets that arrive are visited
+// at all. Rows are
+// in no particular order, Fleet::motion is the fleet's row.
+struct FleetMotion {
+  std::vector<float> sx, sy, dx, dy; // source and destination star
+  std::vector<float> t, dt; // dt is how far along the leg one tick gets
+  std::vector<float> x, y;
+  std::vector<int> departed, arrival; // fleet ticks, see FleetState
+  std::vector<Fleet*> fleet;
+
+  size_t size() const { return t.size(); }
+
+  int add(Fleet& f) {
+    sx.push_back(0); sy.push_back(0); dx.push_back(0); dy.push_back(0);
+    t.push_back(0); dt.push_back(0); x.push_back(0); y.push_back(0);
+    departed.push_back(0); arrival.push_back(0);
+    fleet.push_back(&f);
+    set(size() - 1, f);
+    return size() - 1;
+  }
+
+  void set(int row, const Fleet& f) {
+    sx[row] = f.source->x; sy[row] = f.source->y;
+    dx[row] = f.destination->x; dy[row] = f.destination->y;
+    t[row] = f.t;
+    dt[row] = f.step();
+    x[row] = f.x; y[row] = f.y;
+    departed[row] = f.departed;
+    arrival[row] = f.arrival();
+  }
+
+  // moves the last row into `row`, returns the fleet that moved
+  Fleet *remove(int row) {
+    int last = size() - 1;
+    sx[row] = sx[last]; sy[row] = sy[last]; dx[row] = dx[last]; dy[row] = dy[last];
+    t[row] = t[last]; dt[row] = dt[last]; x[row] = x[last]; y[row] = y[last];
+    departed[row] = departed[last]; arrival[row] = arrival[last];
+    fleet[row] = fleet[last];
+    sx.pop_back(); sy.pop_back(); dx.pop_back(); dy.pop_back();
+    t.pop_back(); dt.pop_back(); x.pop_back(); y.pop_back();
+    departed.pop_back(); arrival.pop_back();
+    fleet.pop_back();
+    return row < last ? fleet[row] : nullptr;
+  }
+
+  // the fleet tick of the next arrival, INT_MAX if nobody is travelling
+  int next_arrival() const {
+    int next = INT_MAX;
+    for(int a : arrival) { next = std::min(next, a); }
+    return next;
+  }
+
+  // every row to fleet tick `ticks`, the rows that arrived are appended
+  // in order
+  void advance(int ticks, std::vector<int>& arrived);
+};
+
+// Published fleet states referred to by events in flight. Events keep the
+// slot so ObservableEvent stays plain data.
+struct FleetSnapshots {
+  std::vector<std::shared_ptr<const FleetState>> states;
+  std::vector<int> free_slots;
+
+  int add(const std::shared_ptr<const FleetState>& state) {
+    if(free_slots.empty()) {
+      states.emplace_back(state);
+      return states.size() - 1;
+    }
+    int h = free_slots.back();
+    free_slots.pop_back();
+    states[h] = state;
+    return h;
+  }
+
+  void remove(int h) {
+    states[h].reset();
+    free_slots.push_back(h);
+  }
+
+  const std::shared_ptr<const FleetState>& ref(int h) const { return states[h]; }
+  const FleetState& operator[](int h) const { return *states[h]; }
+};
+
+// Fleets by the star they are docked at: a list per star threaded through
+// next, by fleet index, in fleet order. Rebuilt whole, which only touches
+// the stars that had fleets the last time.
+struct DockIndex {
+  static const int none = -1;
+
+  std::vector<int> head; // by star index
+  std::vector<int> next; // by fleet index
+  std::vector<int> used; // stars with a list
+
+  // star_of(i) is the index of the star fleet i is docked at, or none
+  template<typename StarOf>
+  void build(size_t stars, size_t fleets, StarOf star_of) {
+    for(int s : used) { head[s] = none; }
+    used.clear();
+    head.resize(stars, none);
+    next.assign(fleets, none);
+    // back to front so the lists come out in fleet order
+    for(int i = (int)fleets - 1; i >= 0; i--) {
+      int s = star_of(i);
+      if(s == none) {
+	continue;
+      }
+      if(head[s] == none) {
+	used.push_back(s);
+      }
+      next[i] = head[s];
+      head[s] = i;
+    }
+  }
+
+  int first(int star) const { return star < (int)head.size() ? head[star] : none; }
+};
+
+struct Simulation;
+
+struct Fleets {
+  int max_id = 0;
+  std::vector<std::shared_ptr<Fleet>> fleets;
+  std::unordered_map<uint32_t, std::weak_ptr<Fleet>> by_name; // by name id
+  NameTable *names;
+  // Per fleet state kept next to fleets, by the same index, so update
+  // doesn't visit every Fleet. The travelling ones are in motion, the
+  // docked ones have the index of their star in docked_at. docked is
+  // built from that by update, for combat and again once the tick is done.
+  FleetMotion motion;
+  std::vector<int> docked_at;
+  DockIndex docked;
+  std::vector<int> placed; // added since the last update, they arrive on it
+  std::mutex add_locker;
+
+  Fleets() {
+    fleets.reserve(128);
+  }
+
+  void add(Fleet&& f) {
+    add_locker.lock();
+    f.id = max_id;
+    f.index = fleets.size();
+    placed.push_back(f.index);
+    docked_at.push_back(DockIndex::none);
+    uint32_t name_id = names->intern(f.name);
+    f.name = names->str(name_id);
+    fleets.emplace_back(std::make_shared<Fleet>(f));
+    by_name.emplace(name_id, fleets.back());
+    sim_log("new fleet with id: %d\n", max_id);
+    max_id++;
+    add_locker.unlock();
+  }
+
+  std::shared_ptr<Fleet> from_name(const char *name) {
+    auto it = by_name.find(names->find(name));
+    if(it == by_name.end()) {
+      return NULL;
+    }
+    return it->second.lock();
+  }
+
+  // keep Fleet::motion in step with the fleet, after it set off or stopped
+  void launch(Fleet& f, int ticks) {
+    if(f.moving == false) {
+      return;
+    }
+    f.departed = ticks;
+    docked_at[f.index] = DockIndex::none;
+    if(f.motion == -1) {
+      f.motion = motion.add(f);
+    }
+    else {
+      motion.set(f.motion, f);
+    }
+  }
+
+  void stop(Fleet& f) {
+    if(f.motion == -1) {
+      return;
+    }
+    if(Fleet *moved = motion.remove(f.motion)) {
+      moved->motion = f.motion;
+    }
+    f.motion = -1;
+  }
+
+  // a star moved in the editor, fleets on lanes to or from it follow
+  void moved(const Star& star) {
+    for(size_t i = 0; i < motion.size(); i++) {
+      Fleet& f = *motion.fleet[i];
+      if(f.source->index == star.index or f.destination->index == star.index) {
+	position(f, f.x, f.y, f.t);
+	motion.set(i, f);
+      }
+    }
+  }
+
+  // where a fleet is now, a travelling one's Fleet only knows where it set off
+  void position(const Fleet& f, float& x, float& y, float& t) const {
+    if(f.motion == -1) {
+      x = f.x; y = f.y; t = f.t;
+    }
+    else {
+      x = motion.x[f.motion]; y = motion.y[f.motion]; t = motion.t[f.motion];
+    }
+  }
+
+  void update(Observations& obs, Simulation& sim);
+};
+
+struct Observer {
+  int id;
+  const char *name;
+  std::shared_ptr<Star> home;
+  Color color;
+
+  // Published states as last seen, see FleetState
+  std::vector<std::shared_ptr<const FleetState>> known_travelling_fleets;
+  std::vector<std::shared_ptr<const FleetState>> known_idle_fleets;
+  // known_idle_fleets by the star they were seen at, rebuilt on the first
+  // look after known_idle_fleets changed
+  mutable DockIndex idle_at;
+  mutable bool idle_dirty = true;
+  // Stars are shared through Stars, this only holds what we know that
+  // differs from the base map, by star index
+  const std::vector<StarState> *base_stars = nullptr;
+  std::unordered_map<int, StarState> known_stars;
+  size_t star_changes = 0; // updates to known_stars, for whatever is drawn from it
+
+  SeenEvents seen_events;
+  DeliveryQueue deliveries; // wavefronts on their way here
+
+  Observer() {
+    known_travelling_fleets.reserve(64);
+    known_idle_fleets.reserve(64);
+  }
+
+  void add_stars(const Stars& stars) {
+    base_stars = &stars.base;
+  }
+
+  const DockIndex& idle_by_star() const {
+    if(idle_dirty == true) {
+      idle_at.build(base_stars->size(), known_idle_fleets.size(),
+		    [this](int i) { return known_idle_fleets[i]->source->index; });
+      idle_dirty = false;
+    }
+    return idle_at;
+  }
+
+  const StarState& known(const Star& star) const {
+    auto it = known_stars.find(star.index);
+    if(it != known_stars.end()) {
+      return it->second;
+    }
+    return (*base_stars)[star.index];
+  }
+
+  void add_event(const ObservableEvent& e) {
+    seen_events.add(e.id);
+  }
+
+  bool has_seen(const ObservableEvent& e) const {
+    return seen_events.has(e.id);
+  }
+
+  void remove_event(int id) {
+    seen_events.remove(id);
+  }
+
+  Observer(const char *_name, const std::shared_ptr<Star>& h, Color c) {
+    name = _name;
+    home = h;
+    color = c;
+  }
+};
+
+struct MessageLog {
+  std::vector<std::string> messages;
+  int year;
+
+  MessageLog() {
+    messages.reserve(32);
+    year = -1;
+  }
+
+  void addMessage(const char *m, bool with_year = true) {
+    // keep last 32 messages
+    if(messages.size() >= 32) {
+      messages.erase(messages.begin());
+    }
+
+    std::stringstream ss;
+    if(with_year == true) {
+      ss << "Year " << year << " ";
+    }
+    ss << m;
+    messages.emplace_back(std::move(ss.str()));
+  }
+
+  void addEventMessage(const ObservableEvent& event, const FleetState& fleet, const Stars& stars);
+};
+
+// Threads that work through the shards of a job together with the
+// calling thread. run() returns once every shard is done, with no
+// threads it runs them in order on the calling thread.
+struct WorkerPool {
+  std::vector<std::thread> threads;
+  std::mutex m;
+  std::condition_variable wake, done;
+  const std::function<void(int)> *job = nullptr;
+  int shards = 0;
+  int next = 0; // next shard to hand out
+  int finished = 0;
+  int generation = 0; // bumped by every run
+  bool stop = false;
+
+  WorkerPool() = default;
+  WorkerPool(const WorkerPool&) = delete;
+  ~WorkerPool() { resize(0); }
+
+  size_t size() const { return threads.size(); }
+  void resize(size_t n);
+  void run(int n, const std::function<void(int)>& f);
+  void work(std::unique_lock<std::mutex>& lock);
+};
+
+struct Observations {
+  EventPool events;
+  std::vector<ObservableEvent> order_add_queue;
+  FleetSnapshots snapshots;
+  Stars *stars;
+
+  std::vector<std::shared_ptr<Observer>> observers;
+  std::shared_ptr<Observer> human_controller;
+
+  int max_observer_id = 0; // id's for Observers
+  int max_event_id = 0; // id's for ObservableEvents
+  int max_event_seq = 0;
+  int tick_events_created = 0;
+
+  int now = 0; // ticks since the start, event ages are relative to this
+  int fleet_ticks = 0; // Fleets::update passes, see FleetState::at
+  DeliveryQueue order_deliveries;
+  std::vector<Delivery> due; // scratch for update
+  // due by observer, as spans into due_by_observer
+  std::vector<int> due_start;
+  std::vector<int> due_by_observer;
+  std::vector<int> due_fill; // scratch for building due_by_observer
+  // Started the first time a tick is worth sharding. Waking the workers
+  // costs more than a few deliveries take to process.
+  WorkerPool workers;
+  static const size_t shard_min_due = 256;
+  std::function<void(int)> shard; // one observer's deliveries, to shard_log
+  MessageLog *shard_log = nullptr;
+
+  Observations() {
+    order_add_queue.reserve(32);
+    observers.reserve(8);
+    shard = [this](int o) {
+      for(int i = due_start[o]; i < due_start[o + 1]; i++) {
+	processEvent(*observers[o], events.get(due[due_by_observer[i]].event), *shard_log);
+      }
+    };
+  }
+
+  void update_star_knowledge(Observer& observer, const std::shared_ptr<Star>& real_star) {
+    sim_log("update_star_knowledge: %s : %s\n", observer.name, real_star->name);
+    if(real_star->version == (*observer.base_stars)[real_star->index].version) {
+      observer.known_stars.erase(real_star->index);
+    }
+    else {
+      observer.known_stars[real_star->index] = real_star->state();
+    }
+    observer.star_changes++;
+  }
+
+  void addFleetDeparture(std::shared_ptr<Fleet>& f) {
+    auto ev = ObservableEvent(ObservableEventType::FleetDeparture, f->x, f->y, max_event_id);
+    max_event_id++;
+    sim_log("Fleet departure: %s, %s to %s\n", f->name, f->source->name, f->destination->name);
+    ev.fleet1 = snapshots.add(f->publish(fleet_ticks));
+    ev.orderTarget = f->source->index;
+    ev.orderMoveTo = f->destination->index;
+    order_add_queue.emplace_back(ev);
+    tick_events_created++;
+  }
+
+  void addFleetArrival(std::shared_ptr<Fleet>& f) {
+    auto ev = ObservableEvent(ObservableEventType::FleetArrival, f->x, f->y, max_event_id);
+    max_event_id++;
+    sim_log("Fleet arrival: %s at %s\n", f->name, f->destination->name);
+    ev.fleet1 = snapshots.add(f->publish(fleet_ticks));
+    ev.orderTarget = f->source->index;
+    ev.orderMoveTo = f->destination->index;
+    ev.birth = now;
+    schedule(ev);
+    tick_events_created++;
+  }
+
+  void addFleetCombat(std::shared_ptr<Fleet>& f) {
+    auto ev = ObservableEvent(ObservableEventType::CombatReport, f->x, f->y, max_event_id);
+    max_event_id++;
+    sim_log("Fleet combat: %s died at %s\n", f->name, f->source->name);
+    ev.fleet1 = snapshots.add(f->publish(fleet_ticks));
+    ev.birth = now;
+    schedule(ev);
+    tick_events_created++;
+  }
+
+  void addOrderFleetMove(std::shared_ptr<Fleet>& f,
+			 std::shared_ptr<Star>& from,
+			 std::shared_ptr<Star>& to,
+			 std::shared_ptr<Observer>& o) {
+    addOrderFleetMove(f->publish(fleet_ticks), from, to, o);
+  }
+
+  // an order about the fleet as the sender knows it
+  void addOrderFleetMove(const std::shared_ptr<const FleetState>& f,
+			 const std::shared_ptr<Star>& from,
+			 const std::shared_ptr<Star>& to,
+			 const std::shared_ptr<Observer>& o) {
+    float x = human_controller->home->x;
+    float y = human_controller->home->y;
+
+    auto ev = ObservableEvent(ObservableEventType::OrderFleetMove, x, y, max_event_id);
+    max_event_id++;
+    ev.fleet1 = snapshots.add(f);
+    ev.orderTarget = from->index;
+    ev.orderMoveTo = to->index;
+    ev.orderSender = o->id;
+    ev.birth = now;
+    schedule(ev);
+    tick_events_created++;
+  }
+
+  void add(Observer&& o) {
+    o.id = max_observer_id;
+    max_observer_id++;
+    observers.emplace_back(std::make_shared<Observer>(o));
+  }
+
+  // radius of the wavefront in light years
+  float age(EventHandle h) const {
+    return now - events.birth[h];
+  }
+
+  void schedule(ObservableEvent& event);
+  void reschedule();
+
+  // the tick (in now) the next wavefront reaches anyone, INT_MAX if none
+  int next_delivery() const {
+    int next = order_deliveries.empty() ? INT_MAX : order_deliveries.top().tick;
+    for(auto&& observer : observers) {
+      if(not observer->deliveries.empty()) {
+	next = std::min(next, observer->deliveries.top().tick);
+      }
+    }
+    return next;
+  }
+  void retire(EventHandle h);
+
+  std::shared_ptr<Fleet> orderTargetIsPresent(Fleets& fleets, const ObservableEvent& event) {
+    std::shared_ptr<Fleet> ret;
+    for(auto&& fleet : fleets.fleets) {
+      if(fleet->id == snapshots[event.fleet1].id) {
+	if(fleet->moving == false and
+	   fleet->destination->index == event.orderTarget and
+	   fleet->source->index == event.orderTarget)
+	  {
+	    return fleet;
+	  }
+      }
+    }
+    return NULL;
+  }
+
+  void processOrder(const StarGraph& g, Fleets& fleets, const ObservableEvent& event, Observer& observer) {
+    if(observer.has_seen(event)) {
+      return;
+    }
+
+    std::shared_ptr<Fleet> f = orderTargetIsPresent(fleets, event);
+
+    if(f) {
+      std::shared_ptr<Star> to = stars->stars[event.orderMoveTo];
+      sim_log("%s received order to move to %s\n", f->name, to->name);
+      f->move_to(g, to);
+      fleets.launch(*f, fleet_ticks);
+      addFleetDeparture(f);
+    }
+    else {
+      sim_log("order failed\n");
+    }
+
+    observer.add_event(event);
+  }
+
+  bool RemoveFleetInVector(std::vector<std::shared_ptr<const FleetState>>& vec,
+			   const std::shared_ptr<Fleet>& fleet) {
+    auto it = vec.begin();
+    while(it != vec.end()) {
+      if((*it)->id == fleet->id) {
+	vec.erase(it);
+	return true;
+      }
+      it++;
+    }
+    sim_log("RemoveFleetInVector: false\n");
+    return false;
+  }
+
+  bool FleetEventInVector(const std::vector<std::shared_ptr<const FleetState>>& vec,
+			  const ObservableEvent& event) {
+    auto it = vec.begin();
+    while(it != vec.end()) {
+      if((*it)->id == snapshots[event.fleet1].id) {
+	return true;
+      }
+      it++;
+    }
+    return false;
+  }
+
+  bool RemoveFleetEventInVector(std::vector<std::shared_ptr<const FleetState>>& vec,
+				const ObservableEvent& event) {
+    auto it = vec.begin();
+    while(it != vec.end()) {
+      if((*it)->id == snapshots[event.fleet1].id) {
+	vec.erase(it);
+	return true;
+      }
+      it++;
+    }
+    sim_log("RemoveFleetEventInVector: false\n");
+    return false;
+  }
+
+  void processEvent(Observer& observer, const ObservableEvent& event, MessageLog& log);
+  void update(const StarGraph& graph, Fleets& fleets, MessageLog& log);
+};
+
+// Parameters for a generated galaxy, see Simulation::generate
+struct Scenario {
+  int stars = 1000;
+  int fleets = 100;
+  int observers = 2;
+  unsigned seed = 1;
+};
+
+// Every input from outside the simulation with the tick it came in at,
+// as a compact binary file: a header with how the simulation was set up,
+// then one record per input. Replaying the records against the same
+// setup gives the same game, see Simulation::apply. Native byte order.
+struct Journal {
+  static const uint32_t version = 1;
+
+  enum class Type : uint8_t { Order = 1, MoveStar, AddStar, Connect, Controller, End };
+
+  struct Header {
+    int start; // Simulation::t
+    bool generated; // by Simulation::generate from scenario, else init
+    Scenario scenario;
+  };
+
+  // which fields are used depends on the type, see Simulation::apply
+  struct Record {
+    int tick; // Simulation::t when it came in, before the next tick
+    Type type;
+    int a = 0, b = 0, c = 0, d = 0;
+    float x = 0, y = 0;
+    std::string name;
+
+    Record() = default;
+    Record(int _tick, Type _type) : tick(_tick), type(_type) { }
+  };
+
+  FILE *f = nullptr;
+
+  Journal() = default;
+  Journal(const Journal&) = delete;
+  ~Journal() { close(); }
+
+  bool create(const char *path, const Header& h);
+  bool open(const char *path, Header& h);
+  void write(const Record& r);
+  bool read(Record& r);
+  void close();
+};
+
+// Everything Game::tick needs, without the engine, the viewport or any
+// of the windows.
+struct Simulation {
+  int t;
+  MessageLog log;
+
+  NameTable names; // star, fleet and observer names
+  Stars stars;
+  Observations obs;
+  Fleets fleets;
+
+  Simulation() {
+    t = 3200;
+    obs.stars = &stars;
+    stars.names = &names;
+    fleets.names = &names;
+  }
+
+  bool generated = false; // by generate, from scenario
+  Scenario scenario;
+  Journal *journal = nullptr; // the inputs below are recorded here when set
+
+  void init();
+  void generate(const Scenario& sc);
+  void tick();
+  void fleetArrived(std::shared_ptr<Fleet>& arrived);
+
+  // Inputs from outside, the UI or a driver. They go through here so
+  // they can be journaled and replayed.
+  void order(const std::shared_ptr<const FleetState>& f, const std::shared_ptr<Star>& from,
+	     const std::shared_ptr<Star>& to, const std::shared_ptr<Observer>& o);
+  void order(std::shared_ptr<Fleet>& f, const std::shared_ptr<Star>& from,
+	     const std::shared_ptr<Star>& to, const std::shared_ptr<Observer>& o) {
+    order(f->publish(obs.fleet_ticks), from, to, o);
+  }
+  void move_star(Star& star, float x, float y);
+  void add_star(const char *name, float x, float y);
+  void connect(const std::shared_ptr<Star>& s1, const std::shared_ptr<Star>& s2);
+  void set_controller(const std::shared_ptr<Observer>& o);
+
+  // an input read back from a journal, false if it doesn't fit the game
+  bool apply(const Journal::Record& r);
+  Journal::Header header() const { return Journal::Header { t, generated, scenario }; }
+  uint64_t checksum() const; // of the state that ticks depend on
+
+  // The whole game to a file and back, see the save file notes in
+  // sim.cpp. load replaces everything, it's false and leaves the game as
+  // it was if the file isn't a save of this version.
+  bool save(const char *path) const;
+  bool load(const char *path);
+  void serialize(std::vector<char>& image) const; // the bytes save writes
+
+  // The next year in which anything but fleets moving along happens. The
+  // ticks before it can be skipped, see fast_forward.
+  int next_event() const;
+  // to `year` with one tick per year in which something happens
+  void fast_forward(int year);
+};
+
+// Saves every `every` ticks without holding up the game. The snapshot is
+// a fork(), copy on write, and the child process serializes the save,
+// writes it out and syncs it while the game goes on ticking. A thread
+// waits for the child and leaves the times in `last`.
+struct Autosave {
+  struct Report {
+    int year = 0; // Simulation::t of the save
+    bool done = false;
+    bool ok = false;
+    double snapshot_ms = 0; // the fork, the only part the game waits for
+    double write_ms = 0; // in the child, from the fork to the end of the sync
+  };
+
+  const char *path;
+  std::string tmp; // path.tmp
+  std::vector<char> image; // only ever filled in the child, reserved to the last save's size
+  int every = 0; // ticks, 0 for never
+  int started = INT_MIN; // Simulation::t of the last one started
+  int saves = 0;
+
+  std::mutex m;
+  Report last; // under m
+  pid_t child = -1; // under m, -1 if there's no save being written
+  std::thread waiter;
+
+  Autosave(const char *_path) : tmp(std::string(_path) + ".tmp") { path = _path; }
+  Autosave(const Autosave&) = delete;
+  ~Autosave() { wait(); }
+
+  // call between ticks, starts a save if one is due and none is running
+  void update(const Simulation& sim);
+  bool busy();
+  Report report();
+  void wait(); // for the save being written, if any
+};
@@ -0,0 +1,210 @@
+// Headless driver for the simulation core: runs Simulation::tick as fast
+// as it can, with no display, fonts or bitmaps.
+
+#include "./sim.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <random>
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+	  "usage: %s [-n ticks] [-o order_every] [-s seed] [-j threads] [-x] [-J journal]\n"
+	  "          [-L save] [-S save] [-A autosave_every] [-v]\n"
+	  "       %s -R journal [-j threads] [-v]\n"
+	  "  -n ticks        number of ticks to simulate (default 10000)\n"
+	  "  -o order_every  issue a random fleet order every n ticks, 0 for none (default 10)\n"
+	  "  -s seed         seed for the random orders (default 1)\n"
+	  "  -j threads      workers for Observations::update, -1 for one per extra core (default -1)\n"
+	  "  -x              skip the ticks in which nothing happens\n"
+	  "  -J journal      record the orders to a journal\n"
+	  "  -R journal      replay a journal, printing the year and a state checksum every tick\n"
+	  "  -L save         start from a saved game instead of the built in one\n"
+	  "  -S save         save the game at the end\n"
+	  "  -A ticks        autosave to 27kelvin-sim.autosave every n ticks, in the background\n"
+	  "  -v              print the simulation log, on one thread\n",
+	  argv0, argv0);
+}
+
+// order a random docked fleet to a random star, like a player clicking around
+static void random_order(Simulation& sim, std::mt19937& rng) {
+  std::vector<std::shared_ptr<Fleet>> idle;
+  for(auto&& fleet : sim.fleets.fleets) {
+    if(fleet->moving == false and fleet->path.empty()) {
+      idle.push_back(fleet);
+    }
+  }
+  if(idle.empty()) {
+    return;
+  }
+
+  std::shared_ptr<Fleet> f = idle[rng() % idle.size()];
+  std::shared_ptr<Star> s = sim.stars.stars[rng() % sim.stars.stars.size()];
+
+  if(s != f->source) {
+    sim.order(f, f->source, s, sim.obs.human_controller);
+  }
+}
+
+// re-run the inputs in a journal as fast as we can
+static int replay_journal(const char *path) {
+  Journal journal;
+  Journal::Header h;
+  if(not journal.open(path, h)) {
+    fprintf(stderr, "%s: can't read journal\n", path);
+    return 1;
+  }
+
+  Simulation sim;
+  if(h.generated) {
+    sim.generate(h.scenario);
+  }
+  else {
+    sim.init();
+  }
+  sim.t = h.start;
+
+  long ticks = 0;
+  long inputs = 0;
+  Journal::Record r;
+  auto start = std::chrono::steady_clock::now();
+  while(journal.read(r)) {
+    while(sim.t < r.tick) {
+      sim.tick();
+      ticks++;
+      printf("%d %016llx\n", sim.t, (unsigned long long)sim.checksum());
+    }
+    if(not sim.apply(r)) {
+      fprintf(stderr, "%s: bad record at year %d\n", path, r.tick);
+      return 1;
+    }
+    inputs++;
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double secs = std::chrono::duration<double>(end - start).count();
+
+  printf("ticks: %ld\n", ticks);
+  printf("inputs: %ld\n", inputs);
+  printf("year: %d\n", sim.t);
+  printf("checksum: %016llx\n", (unsigned long long)sim.checksum());
+  printf("time: %.3fs\n", secs);
+  printf("ticks/sec: %.0f\n", secs > 0 ? ticks / secs : 0);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  long ticks = 10000;
+  long order_every = 10;
+  unsigned seed = 1;
+  bool skip = false;
+  const char *record = NULL;
+  const char *replay = NULL;
+  const char *load = NULL;
+  const char *save = NULL;
+  Autosave autosave("27kelvin-sim.autosave");
+  g_sim_log = false;
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:o:s:j:xJ:R:L:S:A:vh")) != -1) {
+    switch(opt)
+      {
+      case 'n': { ticks = atol(optarg); }; break;
+      case 'o': { order_every = atol(optarg); }; break;
+      case 's': { seed = atoi(optarg); }; break;
+      case 'j': { g_sim_threads = atoi(optarg); }; break;
+      case 'x': { skip = true; }; break;
+      case 'J': { record = optarg; }; break;
+      case 'R': { replay = optarg; }; break;
+      case 'L': { load = optarg; }; break;
+      case 'S': { save = optarg; }; break;
+      case 'A': { autosave.every = atoi(optarg); }; break;
+      case 'v': { g_sim_log = true; }; break;
+      default: { usage(argv[0]); return 1; }; break;
+      }
+  }
+
+  if(replay) {
+    return replay_journal(replay);
+  }
+  if(load and record) {
+    // replays start from a new game
+    fprintf(stderr, "can't record a journal of a loaded game\n");
+    return 1;
+  }
+
+  Simulation sim;
+  double load_secs = 0;
+  if(load) {
+    auto load_start = std::chrono::steady_clock::now();
+    if(not sim.load(load)) {
+      fprintf(stderr, "%s: can't load save\n", load);
+      return 1;
+    }
+    load_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+  }
+  else {
+    sim.init();
+  }
+
+  Journal journal;
+  if(record) {
+    if(not journal.create(record, sim.header())) {
+      perror(record);
+      return 1;
+    }
+    sim.journal = &journal;
+  }
+
+  std::mt19937 rng(seed);
+
+  auto start = std::chrono::steady_clock::now();
+  for(long i = 0; i < ticks; ) {
+    if(order_every > 0 and i % order_every == 0) {
+      random_order(sim, rng);
+    }
+    if(skip == true) {
+      // straight to the next order
+      long next = order_every > 0 ? std::min(ticks, (i / order_every + 1) * order_every) : ticks;
+      sim.fast_forward(sim.t + (next - i));
+      i = next;
+    }
+    else {
+      sim.tick();
+      i++;
+    }
+    autosave.update(sim);
+  }
+  auto end = std::chrono::steady_clock::now();
+  autosave.wait();
+  if(sim.journal) {
+    journal.write(Journal::Record(sim.t, Journal::Type::End));
+  }
+
+  if(save and not sim.save(save)) {
+    perror(save);
+    return 1;
+  }
+
+  double secs = std::chrono::duration<double>(end - start).count();
+
+  if(load) {
+    printf("load: %.3fs\n", load_secs);
+  }
+  printf("ticks: %ld\n", ticks);
+  printf("year: %d\n", sim.t);
+  printf("fleets: %ld\n", sim.fleets.fleets.size());
+  printf("events in flight: %ld\n", sim.obs.events.size());
+  printf("events created: %d\n", sim.obs.max_event_id);
+  printf("checksum: %016llx\n", (unsigned long long)sim.checksum());
+  if(autosave.every > 0) {
+    Autosave::Report last = autosave.report();
+    printf("autosaves: %d, the last in %d %s, snapshot %.3fms, write %.3fms\n", autosave.saves,
+	   last.year, last.ok ? "ok" : "failed", last.snapshot_ms, last.write_ms);
+  }
+  printf("time: %.3fs\n", secs);
+  printf("ticks/sec: %.0f\n", secs > 0 ? ticks / secs : 0);
+}